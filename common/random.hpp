@@ -0,0 +1,109 @@
+// Copyright 2022 NTT CORPORATION
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+/*
+Counter-based random number generator.
+
+The n-th output of a stream is mix64(key + n * gamma), i.e., the output function of SplitMix64 applied to a counter.
+Since an output only depends on (key, n), a stream can jump to any position in O(1) with discard(),
+and independent substreams are obtained by deriving keys from (seed, stream index) with set_stream().
+Executables give a substream to each trial, so that the samples of a trial only depend on the seed and the trial index,
+regardless of how trials are assigned to threads.
+This header is shared by the simulators of all the figures, which add the common directory to their include paths.
+*/
+class Random {
+private:
+	static const uint64_t _gamma = 0x9E3779B97F4A7C15ull;
+	uint64_t _key;
+	uint64_t _counter;
+public:
+	typedef uint64_t result_type;
+
+	static uint64_t mix64(uint64_t z) {
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+	static uint64_t draw_random_seed() {
+		std::random_device rd;
+		return ((uint64_t)rd() << 32) | rd();
+	}
+
+	Random() {
+		set_seed(draw_random_seed());
+	}
+	explicit Random(uint64_t seed, uint64_t stream = 0) {
+		set_stream(seed, stream);
+	}
+	virtual ~Random() {};
+	void set_seed(uint64_t seed) {
+		set_stream(seed, 0);
+	}
+	uint64_t set_random_seed() {
+		uint64_t seed = draw_random_seed();
+		set_seed(seed);
+		return seed;
+	}
+	// restart from the beginning of the stream-th substream of seed
+	void set_stream(uint64_t seed, uint64_t stream) {
+		_key = mix64(seed ^ mix64(stream * 0xD1B54A32D192ED03ull + _gamma));
+		_counter = 0;
+	}
+	// skip the next n outputs
+	void discard(uint64_t n) {
+		_counter += n;
+	}
+	uint64_t next() {
+		return mix64(_key + (++_counter) * _gamma);
+	}
+	// uniform in [0, 1) with 53-bit resolution
+	double sample_double() {
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+	int sample_integer() {
+		return (int)(uint32_t)next();
+	}
+
+	// UniformRandomBitGenerator, so that it can be used with std::shuffle and std distributions
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return ~(result_type)0; }
+	result_type operator()() { return next(); }
+};
+
+/*
+Seed of executables.
+"--seed S" fixes the seed. Otherwise, the seed is 0 in debug build and drawn from random_device in release build.
+*/
+struct SeedOption {
+	bool fixed = false;
+	uint64_t value = 0;
+
+	// remove "--seed S" from arguments and return the new argc
+	int parse(int argc, char** argv) {
+		int count = 0;
+		for (int i = 0; i < argc; ++i) {
+			if (i + 1 < argc && std::strcmp(argv[i], "--seed") == 0) {
+				fixed = true;
+				value = std::strtoull(argv[i + 1], nullptr, 10);
+				++i;
+				continue;
+			}
+			argv[count++] = argv[i];
+		}
+		return count;
+	}
+	uint64_t get() const {
+		if (fixed) return value;
+#ifdef _DEBUG
+		return 0;
+#else
+		return Random::draw_random_seed();
+#endif
+	}
+};
@@ -0,0 +1,36 @@
+// Copyright 2022 NTT CORPORATION
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+/*
+Number of worker threads of executables.
+"--threads N" sets the number, where 0 means the number of hardware threads. The default is 1.
+This header is shared by the simulators of the figures in the same way as random.hpp.
+*/
+struct ThreadOption {
+	uint32_t value = 1;
+
+	// remove "--threads N" from arguments and return the new argc
+	int parse(int argc, char** argv) {
+		int count = 0;
+		for (int i = 0; i < argc; ++i) {
+			if (i + 1 < argc && std::strcmp(argv[i], "--threads") == 0) {
+				value = (uint32_t)std::strtoul(argv[i + 1], nullptr, 10);
+				++i;
+				continue;
+			}
+			argv[count++] = argv[i];
+		}
+		if (value == 0) value = std::max(1u, std::thread::hardware_concurrency());
+		return count;
+	}
+	uint32_t get() const {
+		return value;
+	}
+};
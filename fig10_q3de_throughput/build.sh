@@ -1,5 +1,5 @@
 # Copyright 2022 NTT CORPORATION
 
 mkdir ./bin
-g++ -o ./bin/throughput.out -std=c++11 ./src/main.cpp -O2
+g++ -o ./bin/throughput.out -std=c++11 ./src/main.cpp -I../common -O2
 
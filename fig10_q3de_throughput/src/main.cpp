@@ -8,6 +8,9 @@
 #include <queue>
 #include <fstream>
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include "random.hpp"
 
 #ifdef _MSC_VER
 //#define VISUALIZE
@@ -217,8 +220,8 @@ public:
     int con2;
 };
 
-int run(int width, int n_inst, int seed, double ano_prob, int ano_life) {
-    mt19937 mt(seed);
+int run(int width, int n_inst, uint64_t seed, uint64_t stream, double ano_prob, int ano_life) {
+    Random rng(seed, stream);
     QubitPlane plane(width, width);
     uniform_real_distribution<> urd;
 
@@ -232,7 +235,7 @@ int run(int width, int n_inst, int seed, double ano_prob, int ano_life) {
         indices.push_back(i);
     }
     for (int i = 0; i < n_inst; ++i) {
-        shuffle(indices.begin(), indices.end(), mt);
+        shuffle(indices.begin(), indices.end(), rng);
         inst_list.push_back(Instruction(indices[0], indices[1]));
         inst_finish.push_back(0);
     }
@@ -246,7 +249,7 @@ int run(int width, int n_inst, int seed, double ano_prob, int ano_life) {
         vector<pair<int,int>> bursts;
         for (int y = 0; y < plane.h; ++y) {
             for (int x = 0; x < plane.w; ++x) {
-                if (urd(mt) < ano_prob) {
+                if (urd(rng) < ano_prob) {
                     plane.hit_anomaly(x, y, ano_life);
                     bursts.push_back(make_pair(x, y));
                 }
@@ -317,14 +320,12 @@ int run(int width, int n_inst, int seed, double ano_prob, int ano_life) {
 }
 
 
-int repeat(string filename, int width, int n_inst, int trial, double ano_prob, int ano_life) {
-    random_device rd;
-    mt19937 mt(rd());
+int repeat(string filename, int width, int n_inst, int trial, double ano_prob, int ano_life, uint64_t seed) {
     vector<int> cycle;
     int sum = 0;
     for (int i = 0; i < trial; ++i) {
-        int seed = mt();
-        int c = run(width, n_inst, seed, ano_prob, ano_life);
+        // each trial uses its own substream
+        int c = run(width, n_inst, seed, i, ano_prob, ano_life);
         sum += c;
         cycle.push_back(c);
         cout << i << " " << c << " " << sum * 1.0 / (i + 1) << endl;
@@ -337,6 +338,8 @@ int repeat(string filename, int width, int n_inst, int trial, double ano_prob, i
 }
 
 int main(int argc, char** argv) {
+    SeedOption seed_option;
+    argc = seed_option.parse(argc, argv);
     string filename = "test.txt";
     int width = 5;
     int n_inst = 100;
@@ -357,6 +360,7 @@ int main(int argc, char** argv) {
         ano_life = atoi(argv[6]);
     }
 
-    repeat(filename, width, n_inst, trial, ano_prob, ano_life);
+    uint64_t seed = seed_option.get();
+    repeat(filename, width, n_inst, trial, ano_prob, ano_life, seed);
     return 0;
 }
\ No newline at end of file
@@ -28,6 +28,10 @@ anomaly_sizes = [0, 4]
 # number of iterations
 repeat = 100
 
+# options passed to the executable
+# the geometric-skip sampler gives the same statistics and is faster at low error rates
+options = ["--sampler", "geometric"]
+
 
 
 if len(sys.argv) != 3:
@@ -82,8 +86,7 @@ def spawn_and_wait(thread_id):
             break
         else:
             procname = proc
-            arg = [procname] + task_list[my_task_index]
-            size = arg[-1] 
+            arg = [procname] + task_list[my_task_index] + options
             print(arg)
             process = subprocess.Popen(arg)
             # process = subprocess.Popen(arg, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
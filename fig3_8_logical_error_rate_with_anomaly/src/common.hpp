@@ -3,16 +3,31 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <ctime>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
 #include <random>
 #include <sstream>
+#include <thread>
 #include <tuple>
 #include <vector>
 #include <stdexcept>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Blossom V is optional; without it, only the Union-Find decoder is available
+#ifdef USE_BLOSSOM5
 #include "blossom5/PerfectMatching.h"
+#endif
+#include "random.hpp"
 
 #define rep(i, n) for (int i = 0; i < n; ++i)
 #define rep2(i, k, n) for (int i = k; i < n; ++i)
@@ -28,6 +43,71 @@ class AnomalyInfo {
     AnomalyInfo(int _anomaly_size) : anomaly_size(_anomaly_size){};
 };
 
+// index of the lowest set bit (value must be non-zero)
+inline int count_trailing_zeros(uint64_t value) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (int)index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+// flat bit-packed lattice (layer*height*width)
+//  each row is stored in 64-bit words so that rows can be processed with word-wide bitwise operations.
+//  bits beyond width in the last word of a row are always kept zero.
+class BitLattice {
+   public:
+    int layer;
+    int height;
+    int width;
+    int words_per_row;
+    vector<uint64_t> data;
+    BitLattice(int _layer, int _height, int _width)
+        : layer(_layer), height(_height), width(_width), words_per_row((_width + 63) / 64),
+          data((size_t)_layer * _height * words_per_row, 0) {}
+    BitLattice(int _height, int _width) : BitLattice(1, _height, _width) {}
+
+    uint64_t *row(int z, int y) { return &data[((size_t)z * height + y) * words_per_row]; }
+    const uint64_t *row(int z, int y) const { return &data[((size_t)z * height + y) * words_per_row]; }
+    uint64_t *row(int y) { return row(0, y); }
+    const uint64_t *row(int y) const { return row(0, y); }
+
+    bool get(int z, int y, int x) const { return (row(z, y)[x >> 6] >> (x & 63)) & 1; }
+    bool get(int y, int x) const { return get(0, y, x); }
+    void flip(int z, int y, int x) { row(z, y)[x >> 6] ^= (1ULL << (x & 63)); }
+    void flip(int y, int x) { flip(0, y, x); }
+    void clear() { fill(data.begin(), data.end(), 0); }
+
+    // mask of valid bits in the word-th word of a row
+    uint64_t word_mask(int word) const {
+        int rest = width - word * 64;
+        return (rest >= 64) ? ~0ULL : ((1ULL << rest) - 1);
+    }
+    // the word-th word of a row shifted right by one bit, i.e., bit x holds the original bit x+1
+    uint64_t shifted_word(const uint64_t *row_ptr, int word) const {
+        uint64_t value = row_ptr[word] >> 1;
+        if (word + 1 < words_per_row) value |= (row_ptr[word + 1] << 63);
+        return value;
+    }
+};
+
+// buffers used in make_error, which are reused over trials
+class ErrorWorkspace {
+   public:
+    // measurement result of previous cycle (d*(d-1))
+    BitLattice meas_value_prev;
+    // measurement error of current cycle (d*(d-1))
+    BitLattice meas_error;
+    // horizontal qubit ((d+1)*(d-1))  y\in {0,n} is dummy.
+    BitLattice error_horizontal;
+    // vertical qubit (d*d)
+    BitLattice error_vertical;
+    ErrorWorkspace(int d)
+        : meas_value_prev(d, d - 1), meas_error(d, d - 1), error_horizontal(d + 1, d - 1), error_vertical(d, d) {}
+};
+
 class RecoveryInfo {
  public:
     vector<vector<vector<bool>>> recovery_meas;        // measure correction ((d+1)*d*(d-1))  x\in {0,n} is dummy.
@@ -56,26 +136,285 @@ class RecoveryInfo {
     }
 };
 
+// edge of matching graph
+class MatchingEdge {
+   public:
+    int node1;
+    int node2;
+    int cost;
+};
+
+// buffers of decoders, which live across trials so that no allocation happens in the per-trial path
+class DecoderContext {
+   public:
+    // distance to border
+    vector<int> cost_boundary;
+    // nearest point of anomalous region
+    vector<tuple<int, int, int>> near;
+    // edges of matching graph
+    vector<MatchingEdge> edge_list;
+    // matched partner of each node
+    vector<int> match;
+    // partner of nodes matched to boundary in solve_sparse
+    static const int BOUNDARY = -1;
+
+    // number of nearest neighbours connected to each node in sparse mode (0 = complete graph)
+    int sparse_neighbor_count = 0;
+    // pairs (i, j) with j < i that are connected in sparse mode
+    vector<pair<int, int>> neighbor_pairs;
+    // cost to a hub (e.g., the anomalous region) used in add_hub_neighbors
+    vector<int> hub_cost;
+
+    // reserve buffers for the typical number of active syndromes
+    void reserve(int node_num);
+    // solve minimum-weight perfect matching of edge_list with node_num nodes, and store the result in match
+    void solve(int node_num);
+
+    // collect pairs of sparse_neighbor_count nearest nodes in (z,y,x) manhattan distance into neighbor_pairs
+    void find_neighbors(int d, const vector<tuple<int, int, int>> &nodes);
+    // connect every node to sparse_neighbor_count nodes with the smallest hub_cost
+    void add_hub_neighbors();
+    // solve matching of sparse edge_list, where each node can also be matched to boundary with cost_boundary.
+    //  the result is stored in match, where the partner of a node matched to boundary is BOUNDARY.
+    void solve_sparse(int node_num);
+    // whether node i of node_num nodes is matched to boundary, i.e., to BOUNDARY by solve_sparse or to the dummy node by solve
+    bool matched_to_boundary(int i, int node_num) const { return match[i] == BOUNDARY || match[i] >= node_num; }
+
+   private:
+    // spatial bucket grid for find_neighbors
+    vector<int> bucket_head;
+    vector<int> bucket_next;
+    vector<pair<int, int>> candidate;
+};
+
+// buffers of Union-Find decoder, which live across trials
+//  vertices are syndrome nodes (z,y,x) and a single boundary vertex,
+//  edges are indexed as [horizontal d*d*d][vertical d*(d+1)*(d-1)][meas d*d*(d-1)] following RecoveryInfo.
+//  only the vertices and edges touched in a decode are reset in the next one.
+class UnionFindContext {
+   public:
+    int d = 0;
+    int num_vertex = 0;
+    int num_edge = 0;
+    int boundary_vertex = 0;
+    int offset_vertical = 0;
+    int offset_meas = 0;
+
+    // disjoint-set forest, where parity, has_boundary, and boundary_list are valid at roots
+    vector<int> parent;
+    vector<uint8_t> parity;
+    vector<uint8_t> has_boundary;
+    vector<vector<int>> boundary_list;
+    // growth of each edge in half edges (0, 1, or 2=fully grown)
+    vector<uint8_t> growth;
+    vector<uint8_t> defect;
+    vector<uint8_t> active;
+    vector<uint8_t> visited;
+    vector<uint8_t> is_odd_listed;
+    // spanning forest for peeling
+    vector<int> tree_edge;
+    vector<int> tree_parent;
+    vector<int> visit_order;
+
+    vector<int> touched_vertex;
+    vector<int> touched_edge;
+    // fully grown edges connected to the boundary vertex
+    vector<int> boundary_edge;
+    vector<int> odd_root;
+    // (edge, vertex, vertex) triplets fully grown in the current round
+    vector<int> fusion_edge;
+
+    // allocate buffers for distance d
+    void resize(int _d);
+    // reset vertices and edges touched in the previous decode
+    void clear();
+    int vertex_index(int z, int y, int x) const;
+    // list edges incident to vertex v and their other endpoints, and return the count (at most 6)
+    int incident_edges(int v, int *edges, int *others) const;
+    void flip_recovery(int e, RecoveryInfo &recovery_info) const;
+    int find(int v);
+    // add v to the cluster graph as a singleton cluster if it is not yet
+    void touch(int v);
+    void unite(int u, int v);
+    void grow_edge_to_full(int e, int u, int v);
+};
+
+// burst error (e.g., cosmic-ray event) that starts at an onset cycle, decays over cycles,
+//  and spreads around the center of anomalous region.
+//  the error probability at distance r (in lattice units) from the center and t cycles after onset is
+//  p + (1-p) * peak_prob * exp(-t/decay) * exp(-r^2/(2 spread^2)), and p before onset.
+class BurstModel {
+   public:
+    bool enabled = false;
+    // onset cycle (negative = uniformly random in each trial)
+    int onset = 0;
+    double peak_prob = 0.5;
+    // decay time in cycles (non-positive = no decay)
+    double decay = 0;
+    // spatial spread in lattice units (non-positive = only the center)
+    double spread = 1;
+
+    // probability maps of t=0,...,d-1 cycles after onset, each of which is indexed by
+    //  the offset from the center in doubled coordinates (stabilizer (y,x) is at (2y,2x)) plus map_offset
+    int map_width = 0;
+    int map_offset = 0;
+    vector<double> prob_map;
+
+    // precompute probability maps for distance d and base error probability error_prob
+    void prepare(int d, double error_prob);
+    const double *cycle_map(int t) const { return &prob_map[(size_t)t * map_width * map_width]; }
+};
+
+// which decoder is used
+//  MWPM: minimum-weight perfect matching with Blossom V
+//  UnionFind: almost-linear-time Union-Find decoder with peeling
+enum class DecoderType { MWPM, UnionFind };
+
+// how make_error draws error locations
+//  Bernoulli: one uniform random number per location
+//  Geometric: jump between errors with geometric gaps, and draw the anomalous region separately
+enum class ErrorSampler { Bernoulli, Geometric };
+
+// simulation parameters shared (read-only) by all workers
+class SimulationConfig {
+   public:
+    int d;
+    int anomaly_size;
+    bool use_weight;
+    double error_prob;
+    double error_prob_anomaly;
+    ErrorSampler error_sampler;
+    // burst error replaces the static anomalous region if enabled
+    BurstModel burst_model;
+    DecoderType decoder_type;
+    // number of nearest neighbours in sparse matching graph (0 = complete graph)
+    int sparse_neighbor_count;
+    // also decode with complete graph and count the trials whose results differ
+    bool sparse_verify;
+    bool visualize_flag;
+};
+
+// result of trials, which can be summed over workers
+class TrialResult {
+   public:
+    int trial_count = 0;
+    int misscount = 0;
+    // number of trials where sparse and complete matching graphs give different logical parities
+    int sparse_mismatch_count = 0;
+    void add(const TrialResult& other) {
+        trial_count += other.trial_count;
+        misscount += other.misscount;
+        sparse_mismatch_count += other.sparse_mismatch_count;
+    }
+};
+
+// a worker owns every buffer touched in a trial, so that workers can run on different threads
+class TrialWorker {
+   public:
+    TrialWorker(const SimulationConfig& _config, uint64_t _seed);
+    // perform trials [first_trial, first_trial + trial_count) and return the number of logical errors
+    //  the t-th trial draws random numbers from the t-th substream of seed
+    TrialResult run(int first_trial, int trial_count);
+
+   private:
+    // decode syndrome_active_list and return the left-boundary parity of the recovery
+    //  recovery_info is filled only if fill_recovery is true
+    bool decode(int sparse_neighbor_count, bool fill_recovery);
+
+    const SimulationConfig& config;
+    AnomalyInfo anomaly_info;
+    RecoveryInfo recovery_info;
+    ErrorWorkspace error_workspace;
+    DecoderContext decoder_context;
+    UnionFindContext union_find_context;
+    // measure error (after xor)(d*d*(d-1))
+    BitLattice syndrome_map;
+    // the result of measure (d*d*(d-1))
+    vector<tuple<int, int, int>> syndrome_active_list;
+    uint64_t seed;
+    Random random;
+};
+
+// split trials [first_trial, first_trial + trial_count) over thread_count workers and return the sum of their results
+//  the result only depends on seed, since each trial has its own random substream
+TrialResult run_trials_parallel(const SimulationConfig& config, uint64_t seed, int trial_count, int thread_count, int first_trial = 0);
+
+// stopping rule of adaptive sampling; each criterion is disabled when it is zero
+class StoppingRule {
+   public:
+    // stop when the relative standard error of logical error rate is below this value
+    double target_relative_error = 0;
+    // stop when the number of logical errors reaches this value
+    int min_failures = 0;
+    // stop when the wall-clock time in seconds exceeds this value
+    double time_budget = 0;
+    bool enabled() const { return target_relative_error > 0 || min_failures > 0 || time_budget > 0; }
+};
+
+// perform trials in batches of increasing size until one of the criteria of rule is satisfied or max_trial_count trials are done
+//  the reason for stopping is stored in stop_reason
+TrialResult run_trials_adaptive(const SimulationConfig& config, uint64_t seed, int max_trial_count, int thread_count, const StoppingRule& rule, string& stop_reason);
+
+// Wilson score interval of logical error rate with z standard deviations
+pair<double, double> wilson_interval(int failure_count, int trial_count, double z);
+
+// a point of parameter sweep
+class SweepPoint {
+   public:
+    int d;
+    int anomaly_size;
+    bool use_weight;
+    int trial_count;
+    double error_prob;
+};
+
+// read a grid of sweep points from a file, or from the text itself if it contains "key=values" terms
+vector<SweepPoint> parse_sweep_grid(const string& grid);
+
+// perform all the points of sweep over one pool of thread_count workers
+//  each point is split into chunks of chunk_size trials, and the results are summed per point
+//  the trials of the i-th point use the substreams of a seed derived from (seed, i)
+vector<TrialResult> run_sweep(const vector<SweepPoint>& points, const SimulationConfig& base_config, uint64_t seed, int thread_count, int chunk_size);
+
 bool make_error(
-    int seed, int d,
+    Random& random, int d,
     AnomalyInfo& anomaly_info,
+    ErrorWorkspace& error_workspace,
     vector<tuple<int, int, int>>& syndrome_active_list,
-    vector<vector<vector<bool>>>& syndrome_map,
+    BitLattice& syndrome_map,
     double error_prob,
-    double error_prob_anomaly);
+    double error_prob_anomaly,
+    ErrorSampler error_sampler,
+    const BurstModel& burst_model);
+
+// decoders return the left-boundary parity of the estimated errors, which is counted from boundary crossings
+//  of the recovery paths. recovery_info is cleared and filled with the paths only if fill_recovery is true.
+bool correction_uniform(
+    int d,
+    RecoveryInfo& recovery_info,
+    const vector<tuple<int, int, int>>& syndrome_active_list,
+    DecoderContext& decoder_context,
+    bool fill_recovery);
 
-void correction_uniform(
+bool correction_weighted(
     int d,
     RecoveryInfo& recovery_info,
-    const vector<tuple<int, int, int>>& syndrome_active_list);
+    const vector<tuple<int, int, int>>& syndrome_active_list,
+    const AnomalyInfo& anomaly_info,
+    DecoderContext& decoder_context,
+    bool fill_recovery);
 
-void correction_weighted(
+// Union-Find decoder; with use_weight, edges inside the anomalous region are treated as zero cost
+bool correction_union_find(
     int d,
     RecoveryInfo& recovery_info,
     const vector<tuple<int, int, int>>& syndrome_active_list,
-    const AnomalyInfo& anomaly_info);
+    const AnomalyInfo& anomaly_info,
+    bool use_weight,
+    UnionFindContext& context,
+    bool fill_recovery);
 
 void visualize(
     int d,
     const RecoveryInfo& recovery_info,
-    const vector<vector<vector<bool>>>& syndrome_map);
\ No newline at end of file
+    const BitLattice& syndrome_map);
\ No newline at end of file
@@ -3,60 +3,101 @@
 #include "common.hpp"
 
 // perform matching without considering the position of anomalous region
-//  the estimated errors are stored in recovery info
-void correction_uniform(
+//  return the left-boundary parity of the estimated errors,
+//  which are also stored in recovery info if fill_recovery is true
+bool correction_uniform(
     int d,
     RecoveryInfo &recovery_info,
-    const vector<tuple<int, int, int>> &syndrome_active_list) {
+    const vector<tuple<int, int, int>> &syndrome_active_list,
+    DecoderContext &decoder_context,
+    bool fill_recovery) {
 
     // init bitmap
-    rep(i, d + 1) rep(j, d) rep(k, d - 1) recovery_info.recovery_meas[i][j][k] = false;
-    rep(i, d) rep(j, d + 1) rep(k, d - 1) recovery_info.recovery_vertical[i][j][k] = false;
-    rep(i, d) rep(j, d) rep(k, d) recovery_info.recovery_horizontal[i][j][k] = false;
+    if (fill_recovery) {
+        rep(i, d + 1) rep(j, d) rep(k, d - 1) recovery_info.recovery_meas[i][j][k] = false;
+        rep(i, d) rep(j, d + 1) rep(k, d - 1) recovery_info.recovery_vertical[i][j][k] = false;
+        rep(i, d) rep(j, d) rep(k, d) recovery_info.recovery_horizontal[i][j][k] = false;
+    }
 
     // return if no active node
-    if (syndrome_active_list.size() == 0) return;
+    if (syndrome_active_list.size() == 0) return false;
 
     // calculate cost to boundary
-    vector<int> cost_boundary;
+    vector<int> &cost_boundary = decoder_context.cost_boundary;
+    cost_boundary.clear();
     rep(i, syndrome_active_list.size()) {
         int xi = get<2>(syndrome_active_list[i]);
         cost_boundary.push_back(min(xi + 1, d - xi - 1));
     }
 
 
+    // cost of matching node i and node j
+    auto edge_cost = [&](int i, int j) {
+        int zi = get<0>(syndrome_active_list[i]);
+        int yi = get<1>(syndrome_active_list[i]);
+        int xi = get<2>(syndrome_active_list[i]);
+        int zj = get<0>(syndrome_active_list[j]);
+        int yj = get<1>(syndrome_active_list[j]);
+        int xj = get<2>(syndrome_active_list[j]);
+
+        int dist = abs(zi - zj) + abs(yi - yj) + abs(xi - xj);
+        return min(dist, cost_boundary[i] + cost_boundary[j]);
+    };
+
     // set weight
     int num_pair = ((int)syndrome_active_list.size() + 1) / 2;
     bool odd = (syndrome_active_list.size() & 1);
-    PerfectMatching *pm = new PerfectMatching(2 * num_pair, num_pair * (2 * num_pair - 1));
-    rep(i, syndrome_active_list.size()) {
-        // cout << "vector " << i << " : " << syndrome_active_list[i].first << " " << syndrome_active_list[i].second << endl;
-        rep(j, i) {
-            int zi = get<0>(syndrome_active_list[i]);
-            int yi = get<1>(syndrome_active_list[i]);
-            int xi = get<2>(syndrome_active_list[i]);
-            int zj = get<0>(syndrome_active_list[j]);
-            int yj = get<1>(syndrome_active_list[j]);
-            int xj = get<2>(syndrome_active_list[j]);
-
-            int dist = abs(zi - zj) + abs(yi - yj) + abs(xi - xj);
-            pm->AddEdge(j, i, min(dist, cost_boundary[i] + cost_boundary[j]));
+    vector<MatchingEdge> &edge_list = decoder_context.edge_list;
+    edge_list.clear();
+    if (decoder_context.sparse_neighbor_count > 0) {
+        // connect only nearest neighbours, and boundary
+        decoder_context.find_neighbors(d, syndrome_active_list);
+        for (const auto &pair : decoder_context.neighbor_pairs)
+            edge_list.push_back({pair.second, pair.first, edge_cost(pair.first, pair.second)});
+        decoder_context.solve_sparse((int)syndrome_active_list.size());
+    } else {
+        rep(i, syndrome_active_list.size()) {
+            rep(j, i) edge_list.push_back({j, i, edge_cost(i, j)});
+            if (odd)
+                edge_list.push_back({i, 2 * num_pair - 1, cost_boundary[i]});
         }
-        if (odd)
-            pm->AddEdge(i, 2 * num_pair - 1, cost_boundary[i]);
+
+        // matching
+        decoder_context.solve(2 * num_pair);
     }
 
-    // matching
-    pm->options.verbose = false;
-    pm->Solve();
 
+    // left-boundary parity
+    //  paths between nodes never cross the left boundary, so count the nodes matched to the left boundary
+    auto to_left = [&](int i) {
+        int xi = get<2>(syndrome_active_list[i]);
+        return (xi + 1) < (d - xi - 1);
+    };
+    const int node_num = (int)syndrome_active_list.size();
+    bool logical_parity = false;
+    rep(l, node_num) {
+        int m = decoder_context.match[l];
+        bool to_boundary = decoder_context.matched_to_boundary(l, node_num);
+        if (!to_boundary && !(l < m)) continue;
+        if (to_boundary) {
+            logical_parity ^= to_left(l);
+        } else {
+            int dist = abs(get<0>(syndrome_active_list[l]) - get<0>(syndrome_active_list[m])) +
+                       abs(get<1>(syndrome_active_list[l]) - get<1>(syndrome_active_list[m])) +
+                       abs(get<2>(syndrome_active_list[l]) - get<2>(syndrome_active_list[m]));
+            if (dist >= (cost_boundary[l] + cost_boundary[m]))
+                logical_parity ^= (to_left(l) != to_left(m));
+        }
+    }
+    if (!fill_recovery) return logical_parity;
 
     // reconstruct recovery paths
-    rep(l, 2 * num_pair) {
-        int m = pm->GetMatch(l);
+    rep(l, node_num) {
+        int m = decoder_context.match[l];
+        bool to_boundary = decoder_context.matched_to_boundary(l, node_num);
 
         // iterate only for (l<m)
-        if (!(l < m)) continue;
+        if (!to_boundary && !(l < m)) continue;
 
         int zl = get<0>(syndrome_active_list[l]);
         int yl = get<1>(syndrome_active_list[l]);
@@ -64,7 +105,7 @@ void correction_uniform(
         // cout << k << "-" << l << endl;
 
         // paired to boundary
-        if (odd && (m == (2 * num_pair) - 1)) {
+        if (to_boundary) {
             if ((xl + 1) < (d - xl - 1)) {
                 for (int x = 0; x < (xl + 1); x++)
                     recovery_info.recovery_horizontal[zl][yl][x] = (!recovery_info.recovery_horizontal[zl][yl][x]);
@@ -140,6 +181,5 @@ void correction_uniform(
             }
         }
     }
-    delete pm;
-    return;
+    return logical_parity;
 }
@@ -0,0 +1,302 @@
+// Copyright 2022 NTT CORPORATION
+
+#include "common.hpp"
+
+/*
+Union-Find decoder (Delfosse and Nickerson) on the same lattice as correction_uniform and correction_weighted.
+
+- vertex: syndrome node (z,y,x) in d*d*(d-1), and a single boundary vertex (left and right boundaries)
+- edge: one entry of recovery_horizontal (x-direction), recovery_vertical (y-direction), or recovery_meas (z-direction)
+
+Odd clusters grow by half edges until every cluster has even parity or touches the boundary,
+then the spanning forest of each cluster is peeled from leaves to obtain the recovery.
+In the weighted variant, edges inside the anomalous region have zero cost and are grown from the beginning.
+*/
+
+void UnionFindContext::resize(int _d) {
+    d = _d;
+    num_vertex = d * d * (d - 1) + 1;
+    boundary_vertex = num_vertex - 1;
+    offset_vertical = d * d * d;
+    offset_meas = offset_vertical + d * (d + 1) * (d - 1);
+    num_edge = offset_meas + d * d * (d - 1);
+
+    parent.resize(num_vertex);
+    rep(v, num_vertex) parent[v] = v;
+    parity.assign(num_vertex, 0);
+    has_boundary.assign(num_vertex, 0);
+    defect.assign(num_vertex, 0);
+    active.assign(num_vertex, 0);
+    visited.assign(num_vertex, 0);
+    is_odd_listed.assign(num_vertex, 0);
+    tree_edge.assign(num_vertex, -1);
+    tree_parent.assign(num_vertex, -1);
+    boundary_list.assign(num_vertex, vector<int>());
+    growth.assign(num_edge, 0);
+    has_boundary[boundary_vertex] = 1;
+}
+
+int UnionFindContext::vertex_index(int z, int y, int x) const {
+    return (z * d + y) * (d - 1) + x;
+}
+
+int UnionFindContext::incident_edges(int v, int *edges, int *others) const {
+    int x = v % (d - 1);
+    int y = (v / (d - 1)) % d;
+    int z = v / ((d - 1) * d);
+    int count = 0;
+    // x-direction: edge x connects (x-1) and x, where x=0 and x=d-1 are connected to boundary
+    edges[count] = (z * d + y) * d + x;
+    others[count++] = (x == 0) ? boundary_vertex : vertex_index(z, y, x - 1);
+    edges[count] = (z * d + y) * d + x + 1;
+    others[count++] = (x + 1 == d - 1) ? boundary_vertex : vertex_index(z, y, x + 1);
+    // y-direction: edge y connects (y-1) and y
+    if (y >= 1) {
+        edges[count] = offset_vertical + (z * (d + 1) + y) * (d - 1) + x;
+        others[count++] = vertex_index(z, y - 1, x);
+    }
+    if (y + 1 <= d - 1) {
+        edges[count] = offset_vertical + (z * (d + 1) + y + 1) * (d - 1) + x;
+        others[count++] = vertex_index(z, y + 1, x);
+    }
+    // z-direction: edge z connects (z-1) and z
+    if (z >= 1) {
+        edges[count] = offset_meas + (z * d + y) * (d - 1) + x;
+        others[count++] = vertex_index(z - 1, y, x);
+    }
+    if (z + 1 <= d - 1) {
+        edges[count] = offset_meas + ((z + 1) * d + y) * (d - 1) + x;
+        others[count++] = vertex_index(z + 1, y, x);
+    }
+    return count;
+}
+
+void UnionFindContext::flip_recovery(int e, RecoveryInfo &recovery_info) const {
+    if (e < offset_vertical) {
+        int x = e % d;
+        int y = (e / d) % d;
+        int z = e / (d * d);
+        recovery_info.recovery_horizontal[z][y][x] = (!recovery_info.recovery_horizontal[z][y][x]);
+    } else if (e < offset_meas) {
+        e -= offset_vertical;
+        int x = e % (d - 1);
+        int y = (e / (d - 1)) % (d + 1);
+        int z = e / ((d - 1) * (d + 1));
+        recovery_info.recovery_vertical[z][y][x] = (!recovery_info.recovery_vertical[z][y][x]);
+    } else {
+        e -= offset_meas;
+        int x = e % (d - 1);
+        int y = (e / (d - 1)) % d;
+        int z = e / ((d - 1) * d);
+        recovery_info.recovery_meas[z][y][x] = (!recovery_info.recovery_meas[z][y][x]);
+    }
+}
+
+int UnionFindContext::find(int v) {
+    while (parent[v] != v) {
+        parent[v] = parent[parent[v]];
+        v = parent[v];
+    }
+    return v;
+}
+
+void UnionFindContext::touch(int v) {
+    if (active[v]) return;
+    active[v] = 1;
+    touched_vertex.push_back(v);
+    if (v != boundary_vertex) boundary_list[v].push_back(v);
+}
+
+void UnionFindContext::unite(int u, int v) {
+    int ru = find(u);
+    int rv = find(v);
+    if (ru == rv) return;
+    // the root keeps the longer boundary list
+    if (boundary_list[ru].size() < boundary_list[rv].size()) swap(ru, rv);
+    parent[rv] = ru;
+    parity[ru] ^= parity[rv];
+    has_boundary[ru] |= has_boundary[rv];
+    boundary_list[ru].insert(boundary_list[ru].end(), boundary_list[rv].begin(), boundary_list[rv].end());
+    boundary_list[rv].clear();
+}
+
+void UnionFindContext::grow_edge_to_full(int e, int u, int v) {
+    if (growth[e] == 0) touched_edge.push_back(e);
+    growth[e] = 2;
+    touch(u);
+    touch(v);
+    unite(u, v);
+    if (u == boundary_vertex || v == boundary_vertex) boundary_edge.push_back(e);
+}
+
+void UnionFindContext::clear() {
+    for (int v : touched_vertex) {
+        parent[v] = v;
+        parity[v] = 0;
+        has_boundary[v] = (v == boundary_vertex);
+        defect[v] = 0;
+        active[v] = 0;
+        visited[v] = 0;
+        tree_edge[v] = -1;
+        tree_parent[v] = -1;
+        boundary_list[v].clear();
+    }
+    for (int e : touched_edge) growth[e] = 0;
+    touched_vertex.clear();
+    touched_edge.clear();
+    boundary_edge.clear();
+}
+
+bool correction_union_find(
+    int d,
+    RecoveryInfo &recovery_info,
+    const vector<tuple<int, int, int>> &syndrome_active_list,
+    const AnomalyInfo &anomaly_info,
+    bool use_weight,
+    UnionFindContext &context,
+    bool fill_recovery) {
+
+    // init bitmap
+    if (fill_recovery) {
+        rep(i, d + 1) rep(j, d) rep(k, d - 1) recovery_info.recovery_meas[i][j][k] = false;
+        rep(i, d) rep(j, d + 1) rep(k, d - 1) recovery_info.recovery_vertical[i][j][k] = false;
+        rep(i, d) rep(j, d) rep(k, d) recovery_info.recovery_horizontal[i][j][k] = false;
+    }
+
+    // return if no active node
+    if (syndrome_active_list.size() == 0) return false;
+
+    if (context.d != d) context.resize(d);
+    context.clear();
+
+    int edges[6];
+    int others[6];
+
+    // defects are odd clusters
+    context.touch(context.boundary_vertex);
+    for (const auto &node : syndrome_active_list) {
+        int v = context.vertex_index(get<0>(node), get<1>(node), get<2>(node));
+        context.touch(v);
+        context.defect[v] = 1;
+        context.parity[v] = 1;
+    }
+
+    // edges inside anomalous region have zero cost, so they are fully grown from the beginning
+    if (use_weight && anomaly_info.anomaly_size > 0) {
+        const int ay = anomaly_info.anomaly_y;
+        const int ax = anomaly_info.anomaly_x;
+        const int as = anomaly_info.anomaly_size;
+        rep(z, d) rep2(y, ay, ay + as + 1) rep2(x, ax, ax + as + 1) {
+            int v = context.vertex_index(z, y, x);
+            int count = context.incident_edges(v, edges, others);
+            rep(k, count) {
+                int u = others[k];
+                if (u == context.boundary_vertex) continue;
+                int uy = (u / (d - 1)) % d;
+                int ux = u % (d - 1);
+                if (uy < ay || ay + as < uy || ux < ax || ax + as < ux) continue;
+                if (context.growth[edges[k]] == 2) continue;
+                context.grow_edge_to_full(edges[k], v, u);
+            }
+        }
+    }
+
+    // grow odd clusters until all the clusters are even or touch the boundary
+    while (true) {
+        context.odd_root.clear();
+        for (const auto &node : syndrome_active_list) {
+            int r = context.find(context.vertex_index(get<0>(node), get<1>(node), get<2>(node)));
+            if (context.parity[r] && !context.has_boundary[r] && !context.is_odd_listed[r]) {
+                context.is_odd_listed[r] = 1;
+                context.odd_root.push_back(r);
+            }
+        }
+        if (context.odd_root.size() == 0) break;
+
+        // grow boundaries of odd clusters by half edges
+        context.fusion_edge.clear();
+        for (int r : context.odd_root) {
+            context.is_odd_listed[r] = 0;
+            for (int v : context.boundary_list[r]) {
+                int count = context.incident_edges(v, edges, others);
+                rep(k, count) {
+                    int e = edges[k];
+                    if (context.growth[e] == 2) continue;
+                    if (context.growth[e] == 0) context.touched_edge.push_back(e);
+                    context.growth[e]++;
+                    if (context.growth[e] == 2) {
+                        context.fusion_edge.push_back(e);
+                        context.fusion_edge.push_back(v);
+                        context.fusion_edge.push_back(others[k]);
+                    }
+                }
+            }
+        }
+
+        // merge clusters connected by fully grown edges
+        for (size_t i = 0; i < context.fusion_edge.size(); i += 3) {
+            int e = context.fusion_edge[i];
+            int u = context.fusion_edge[i + 1];
+            int v = context.fusion_edge[i + 2];
+            context.touch(u);
+            context.touch(v);
+            context.unite(u, v);
+            if (u == context.boundary_vertex || v == context.boundary_vertex) context.boundary_edge.push_back(e);
+        }
+    }
+
+    // build spanning forest of fully grown edges, the boundary vertex first so that it becomes a root
+    vector<int> &order = context.visit_order;
+    order.clear();
+    auto visit_tree = [&](int root) {
+        size_t head = order.size();
+        context.visited[root] = 1;
+        order.push_back(root);
+        while (head < order.size()) {
+            int v = order[head++];
+            if (v == context.boundary_vertex) {
+                for (int e : context.boundary_edge) {
+                    // find the non-boundary endpoint of boundary edge e
+                    int x = e % d;
+                    int y = (e / d) % d;
+                    int z = e / (d * d);
+                    int u = context.vertex_index(z, y, (x == 0) ? 0 : d - 2);
+                    if (context.visited[u]) continue;
+                    context.visited[u] = 1;
+                    context.tree_edge[u] = e;
+                    context.tree_parent[u] = v;
+                    order.push_back(u);
+                }
+            } else {
+                int count = context.incident_edges(v, edges, others);
+                rep(k, count) {
+                    int u = others[k];
+                    if (context.growth[edges[k]] != 2 || context.visited[u]) continue;
+                    context.visited[u] = 1;
+                    context.tree_edge[u] = edges[k];
+                    context.tree_parent[u] = v;
+                    order.push_back(u);
+                }
+            }
+        }
+    };
+    visit_tree(context.boundary_vertex);
+    for (const auto &node : syndrome_active_list) {
+        int v = context.vertex_index(get<0>(node), get<1>(node), get<2>(node));
+        if (!context.visited[v]) visit_tree(v);
+    }
+
+    // peel leaves: an edge to the parent is in the recovery if the leaf is a defect
+    //  the left-boundary parity is the number of recovered edges at x=0 (horizontal edges with x=0)
+    bool logical_parity = false;
+    for (int i = (int)order.size() - 1; i >= 0; --i) {
+        int v = order[i];
+        if (!context.defect[v] || context.tree_parent[v] == -1) continue;
+        int e = context.tree_edge[v];
+        if (e < context.offset_vertical && e % d == 0) logical_parity = !logical_parity;
+        if (fill_recovery) context.flip_recovery(e, recovery_info);
+        context.defect[v] = 0;
+        context.defect[context.tree_parent[v]] ^= 1;
+    }
+    return logical_parity;
+}
@@ -3,12 +3,15 @@
 #include "common.hpp"
 
 // perform matching with considering the position of anomalous region
-//  the estimated errors are stored in recovery info
-void correction_weighted(
+//  return the left-boundary parity of the estimated errors,
+//  which are also stored in recovery info if fill_recovery is true
+bool correction_weighted(
     int d,
     RecoveryInfo &recovery_info,
     const vector<tuple<int, int, int>> &syndrome_active_list,
-    const AnomalyInfo& anomaly_info) {
+    const AnomalyInfo& anomaly_info,
+    DecoderContext& decoder_context,
+    bool fill_recovery) {
     
 
     // we assume cost of normal edge is 1 and anomalous edge is 0
@@ -22,17 +25,21 @@ void correction_weighted(
     int cur_z, cur_y, cur_x;
     int cost_candidate[3];
 
-    rep(i, d + 1) rep(j, d) rep(k, d - 1) recovery_info.recovery_meas[i][j][k] = false;
-    rep(i, d) rep(j, d + 1) rep(k, d - 1) recovery_info.recovery_vertical[i][j][k] = false;
-    rep(i, d) rep(j, d) rep(k, d) recovery_info.recovery_horizontal[i][j][k] = false;
+    if (fill_recovery) {
+        rep(i, d + 1) rep(j, d) rep(k, d - 1) recovery_info.recovery_meas[i][j][k] = false;
+        rep(i, d) rep(j, d + 1) rep(k, d - 1) recovery_info.recovery_vertical[i][j][k] = false;
+        rep(i, d) rep(j, d) rep(k, d) recovery_info.recovery_horizontal[i][j][k] = false;
+    }
 
     if (syndrome_active_list.size() == 0)
-        return;
+        return false;
 
     // distance to border
-    vector<int> cost_boundary;
+    vector<int> &cost_boundary = decoder_context.cost_boundary;
+    cost_boundary.clear();
     // nearest point of anomalous region
-    vector<tuple<int, int, int>> near;
+    vector<tuple<int, int, int>> &near = decoder_context.near;
+    near.clear();
     rep(i, syndrome_active_list.size()) {
 
         // pick nearest point of anomalous region
@@ -65,53 +72,101 @@ void correction_weighted(
         cost_boundary.push_back(min(cost_candidate[0], cost_candidate[1]));
     }
 
+    // manhattan distance
+    auto manhattan_cost = [&](int i, int j) {
+        return
+            (cost_normal * abs(get<0>(syndrome_active_list[i]) - get<0>(syndrome_active_list[j]))) + 
+            (cost_normal * abs(get<1>(syndrome_active_list[i]) - get<1>(syndrome_active_list[j]))) + 
+            (cost_normal * abs(get<2>(syndrome_active_list[i]) - get<2>(syndrome_active_list[j])));
+    };
+
+    // (node to anomalous region) + (move inside anomalous region) + (anomalous region to node)
+    auto anomaly_path_cost = [&](int i, int j) {
+        int cost = 
+            (cost_normal * abs(get<0>(syndrome_active_list[i]) - get<0>(near[i]))) + 
+            (cost_normal * abs(get<1>(syndrome_active_list[i]) - get<1>(near[i]))) + 
+            (cost_normal * abs(get<2>(syndrome_active_list[i]) - get<2>(near[i])));
+        cost += 
+            (cost_anomaly * abs(get<0>(near[i]) - get<0>(near[j]))) + 
+            (cost_anomaly * abs(get<1>(near[i]) - get<1>(near[j]))) + 
+            (cost_anomaly * abs(get<2>(near[i]) - get<2>(near[j])));
+        cost += 
+            (cost_normal * abs(get<0>(syndrome_active_list[j]) - get<0>(near[j]))) + 
+            (cost_normal * abs(get<1>(syndrome_active_list[j]) - get<1>(near[j]))) + 
+            (cost_normal * abs(get<2>(syndrome_active_list[j]) - get<2>(near[j])));
+        return cost;
+    };
+
+    // cost of matching node i and node j
+    auto edge_cost = [&](int i, int j) {
+        // (node1 to boundary) + (node2 to boundary)
+        return min(min(manhattan_cost(i, j), anomaly_path_cost(i, j)), cost_boundary[i] + cost_boundary[j]);
+    };
+
     // set weight
     bool odd = (syndrome_active_list.size() & 1);
     int num_pair = ((int)syndrome_active_list.size() + 1) / 2;
-    PerfectMatching *pm = new PerfectMatching(2 * num_pair, num_pair * (2 * num_pair - 1));
-    rep(i, syndrome_active_list.size()) {
-        // cout << "vector " << i << " : " << syndrome_active_list[i].first << " " << syndrome_active_list[i].second << endl;
-        rep(j, i) {
-
-            // manhattan distance
-            cost_candidate[0] = 
-                (cost_normal * abs(get<0>(syndrome_active_list[i]) - get<0>(syndrome_active_list[j]))) + 
-                (cost_normal * abs(get<1>(syndrome_active_list[i]) - get<1>(syndrome_active_list[j]))) + 
-                (cost_normal * abs(get<2>(syndrome_active_list[i]) - get<2>(syndrome_active_list[j])));
-
-            // (node to anomalous region) + (move inside anomalous region) + (anomalous region to node)
-            cost_candidate[1] = 
-                (cost_normal * abs(get<0>(syndrome_active_list[i]) - get<0>(near[i]))) + 
-                (cost_normal * abs(get<1>(syndrome_active_list[i]) - get<1>(near[i]))) + 
-                (cost_normal * abs(get<2>(syndrome_active_list[i]) - get<2>(near[i])));
-            cost_candidate[1] += 
-                (cost_anomaly * abs(get<0>(near[i]) - get<0>(near[j]))) + 
-                (cost_anomaly * abs(get<1>(near[i]) - get<1>(near[j]))) + 
-                (cost_anomaly * abs(get<2>(near[i]) - get<2>(near[j])));
-            cost_candidate[1] += 
-                (cost_normal * abs(get<0>(syndrome_active_list[j]) - get<0>(near[j]))) + 
-                (cost_normal * abs(get<1>(syndrome_active_list[j]) - get<1>(near[j]))) + 
-                (cost_normal * abs(get<2>(syndrome_active_list[j]) - get<2>(near[j])));
+    vector<MatchingEdge> &edge_list = decoder_context.edge_list;
+    edge_list.clear();
+    if (decoder_context.sparse_neighbor_count > 0) {
+        // connect nearest neighbours, nodes nearest to anomalous region (via which paths are cheap), and boundary
+        decoder_context.find_neighbors(d, syndrome_active_list);
+        vector<int> &anomaly_distance = decoder_context.hub_cost;
+        anomaly_distance.clear();
+        rep(i, syndrome_active_list.size()) {
+            anomaly_distance.push_back(
+                abs(get<0>(syndrome_active_list[i]) - get<0>(near[i])) +
+                abs(get<1>(syndrome_active_list[i]) - get<1>(near[i])) +
+                abs(get<2>(syndrome_active_list[i]) - get<2>(near[i])));
+        }
+        decoder_context.add_hub_neighbors();
+        for (const auto &pair : decoder_context.neighbor_pairs)
+            edge_list.push_back({pair.second, pair.first, edge_cost(pair.first, pair.second)});
+        decoder_context.solve_sparse((int)syndrome_active_list.size());
+    } else {
+        rep(i, syndrome_active_list.size()) {
+            rep(j, i) edge_list.push_back({j, i, edge_cost(i, j)});
+            if (odd)
+                edge_list.push_back({i, 2 * num_pair - 1, cost_boundary[i]});
+        }
 
-            // (node1 to boundary) + (node2 to boundary)
-            cost_candidate[2] = cost_boundary[i] + cost_boundary[j];
+        // solve matching
+        decoder_context.solve(2 * num_pair);
+    }
 
-            int minimum_cost = min(min(cost_candidate[0], cost_candidate[1]), cost_candidate[2]);
-            pm->AddEdge(j, i, minimum_cost);
+    // left-boundary parity
+    //  paths between nodes never cross the left boundary, so count the nodes whose boundary paths go to the left
+    auto to_left = [&](int i) {
+        int xi = get<2>(syndrome_active_list[i]);
+        int cost_left = (cost_anomaly * (get<2>(near[i]) - anomaly_x)) + (cost_normal * (anomaly_x + 1));
+        int cost_right = (cost_anomaly * (anomaly_x + anomaly_size - get<2>(near[i]))) + (cost_normal * (d - (anomaly_x + anomaly_size) - 1));
+        int cost_direct = cost_normal * min(xi + 1, d - xi - 1);
+        int cost_via_anomaly = (cost_normal * abs(get<1>(near[i]) - get<1>(syndrome_active_list[i]))) + (cost_normal * abs(get<2>(near[i]) - xi)) + min(cost_left, cost_right);
+        if (cost_direct <= cost_via_anomaly) return (xi + 1) < (d - xi - 1);
+        return cost_left < cost_right;
+    };
+    const int node_num = (int)syndrome_active_list.size();
+    bool logical_parity = false;
+    rep(l, node_num) {
+        int m = decoder_context.match[l];
+        bool to_boundary = decoder_context.matched_to_boundary(l, node_num);
+        if (!to_boundary && !(l < m)) continue;
+        if (to_boundary) {
+            logical_parity ^= to_left(l);
+        } else {
+            int cost_pair = min(manhattan_cost(l, m), anomaly_path_cost(l, m));
+            if ((cost_boundary[l] + cost_boundary[m]) < cost_pair)
+                logical_parity ^= (to_left(l) != to_left(m));
         }
-        if (odd)
-            pm->AddEdge(i, 2 * num_pair - 1, cost_boundary[i]);
     }
+    if (!fill_recovery) return logical_parity;
 
-    // solve matching
-    pm->options.verbose = false;
-    pm->Solve();
-
-    rep(l, 2 * num_pair) {
-        int m = pm->GetMatch(l);
-        if (!(l < m)) continue;
+    rep(l, node_num) {
+        int m = decoder_context.match[l];
+        bool to_boundary = decoder_context.matched_to_boundary(l, node_num);
+        if (!to_boundary && !(l < m)) continue;
         // matched to boundary
-        if (odd && (m == (2 * num_pair) - 1)) {
+        if (to_boundary) {
             cost_candidate[0] = cost_normal * min(get<2>(syndrome_active_list[l]) + 1, d - get<2>(syndrome_active_list[l]) - 1);
             cost_candidate[1] = (cost_normal * abs(get<0>(near[l]) - get<0>(syndrome_active_list[l]))) + (cost_normal * abs(get<1>(near[l]) - get<1>(syndrome_active_list[l]))) + (cost_normal * abs(get<2>(near[l]) - get<2>(syndrome_active_list[l]))) + min((cost_anomaly * (get<2>(near[l]) - anomaly_x)) + (cost_normal * (anomaly_x + 1)), (cost_anomaly * (anomaly_x + anomaly_size - get<2>(near[l]))) + (cost_normal * (d - (anomaly_x + anomaly_size) - 1)));
             if (cost_candidate[0] <= cost_candidate[1]) {
@@ -414,6 +469,5 @@ void correction_weighted(
             }
         }
     }
-    delete pm;
-    return;
+    return logical_parity;
 }
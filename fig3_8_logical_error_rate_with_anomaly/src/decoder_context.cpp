@@ -0,0 +1,128 @@
+// Copyright 2022 NTT CORPORATION
+
+#include "common.hpp"
+
+const int DecoderContext::BOUNDARY;
+
+void DecoderContext::reserve(int node_num) {
+    cost_boundary.reserve(node_num);
+    near.reserve(node_num);
+    match.reserve(node_num);
+    edge_list.reserve((size_t)node_num * node_num / 2);
+}
+
+// Blossom V cannot reset the graph of an existing instance, so a matching instance is created per call,
+//  sized exactly by edge_list and released before return. All the other buffers are kept in the context.
+void DecoderContext::solve(int node_num) {
+#ifdef USE_BLOSSOM5
+    PerfectMatching pm(node_num, (int)edge_list.size());
+    for (const auto &edge : edge_list) {
+        pm.AddEdge(edge.node1, edge.node2, edge.cost);
+    }
+    pm.options.verbose = false;
+    pm.Solve();
+
+    match.resize(node_num);
+    rep(i, node_num) match[i] = pm.GetMatch(i);
+#else
+    (void)node_num;
+    throw std::runtime_error("built without Blossom V");
+#endif
+}
+
+void DecoderContext::find_neighbors(int d, const vector<tuple<int, int, int>> &nodes) {
+    const int cell = 4;
+    const int gz = (d + cell - 1) / cell;
+    const int gy = (d + cell - 1) / cell;
+    const int gx = (d - 1 + cell - 1) / cell;
+    const int k = sparse_neighbor_count;
+    const int node_num = (int)nodes.size();
+
+    // put nodes into buckets (linked lists)
+    bucket_head.assign(gz * gy * gx, -1);
+    bucket_next.resize(node_num);
+    rep(i, node_num) {
+        int b = ((get<0>(nodes[i]) / cell) * gy + (get<1>(nodes[i]) / cell)) * gx + (get<2>(nodes[i]) / cell);
+        bucket_next[i] = bucket_head[b];
+        bucket_head[b] = i;
+    }
+
+    neighbor_pairs.clear();
+    rep(i, node_num) {
+        const int zi = get<0>(nodes[i]);
+        const int yi = get<1>(nodes[i]);
+        const int xi = get<2>(nodes[i]);
+        const int cz = zi / cell;
+        const int cy = yi / cell;
+        const int cx = xi / cell;
+        candidate.clear();
+
+        // search rings of buckets with increasing Chebyshev radius
+        //  nodes outside of the r-th ring are farther than r*cell, so we can stop when k candidates are within it
+        for (int r = 0; r <= max(max(gz, gy), gx); ++r) {
+            rep2(bz, max(cz - r, 0), min(cz + r + 1, gz)) rep2(by, max(cy - r, 0), min(cy + r + 1, gy)) rep2(bx, max(cx - r, 0), min(cx + r + 1, gx)) {
+                if (max(max(abs(bz - cz), abs(by - cy)), abs(bx - cx)) != r) continue;
+                for (int j = bucket_head[(bz * gy + by) * gx + bx]; j != -1; j = bucket_next[j]) {
+                    if (j == i) continue;
+                    int dist = abs(zi - get<0>(nodes[j])) + abs(yi - get<1>(nodes[j])) + abs(xi - get<2>(nodes[j]));
+                    candidate.push_back({dist, j});
+                }
+            }
+            if ((int)candidate.size() >= k) {
+                nth_element(candidate.begin(), candidate.begin() + (k - 1), candidate.end());
+                if (candidate[k - 1].first <= r * cell) break;
+            }
+        }
+        if ((int)candidate.size() > k) {
+            nth_element(candidate.begin(), candidate.begin() + (k - 1), candidate.end());
+            candidate.resize(k);
+        }
+        for (const auto &c : candidate) {
+            neighbor_pairs.push_back({max(i, c.second), min(i, c.second)});
+        }
+    }
+    sort(neighbor_pairs.begin(), neighbor_pairs.end());
+    neighbor_pairs.erase(unique(neighbor_pairs.begin(), neighbor_pairs.end()), neighbor_pairs.end());
+}
+
+void DecoderContext::add_hub_neighbors() {
+    const int node_num = (int)hub_cost.size();
+    const int k = min(sparse_neighbor_count, node_num);
+    candidate.clear();
+    rep(i, node_num) candidate.push_back({hub_cost[i], i});
+    nth_element(candidate.begin(), candidate.begin() + (k - 1), candidate.end());
+    rep(h, k) {
+        int hub = candidate[h].second;
+        rep(i, node_num) {
+            if (i != hub) neighbor_pairs.push_back({max(i, hub), min(i, hub)});
+        }
+    }
+    sort(neighbor_pairs.begin(), neighbor_pairs.end());
+    neighbor_pairs.erase(unique(neighbor_pairs.begin(), neighbor_pairs.end()), neighbor_pairs.end());
+}
+
+// Each node i has a boundary twin node_num+i connected with cost_boundary[i].
+//  Twins i and j are connected with zero cost whenever i and j are connected, so that a perfect matching always exists
+//  (all nodes to their twins) and any pairing of nodes leaves the corresponding twins matchable.
+void DecoderContext::solve_sparse(int node_num) {
+#ifdef USE_BLOSSOM5
+    PerfectMatching pm(2 * node_num, 2 * (int)edge_list.size() + node_num);
+    for (const auto &edge : edge_list) {
+        pm.AddEdge(edge.node1, edge.node2, edge.cost);
+        pm.AddEdge(node_num + edge.node1, node_num + edge.node2, 0);
+    }
+    rep(i, node_num) pm.AddEdge(i, node_num + i, cost_boundary[i]);
+    pm.options.verbose = false;
+    pm.Solve();
+
+    // nodes matched to their twins are matched to boundary
+    match.assign(node_num, BOUNDARY);
+    rep(i, node_num) {
+        int m = pm.GetMatch(i);
+        if (m < node_num) match[i] = m;
+    }
+#else
+    (void)node_num;
+    throw std::runtime_error("built without Blossom V");
+#endif
+}
@@ -3,24 +3,24 @@
 #include "common.hpp"
 
 
-// calculate left-boundary parity of estimated errors
-bool check(int d, const RecoveryInfo &recovery_info) {
-    bool recovery_parity = false;
-    rep(z, d) {
-        rep(y, d) {
-            if (recovery_info.recovery_horizontal[z][y][0])
-                recovery_parity = (!recovery_parity);
-        }
-    }
-    return recovery_parity;
-}
-
 void invalid_exit(string msg) {
     cerr << msg << endl;
     throw std::runtime_error(msg.c_str());
     exit(1);
 }
 
+static void check_point(int d, int anomaly_size, bool use_weight) {
+    if (d % 2 == 0) {
+        invalid_exit("code distance is even");
+    }
+    if (d <= anomaly_size + 1) {
+        invalid_exit("anomaly_size is too large");
+    }
+    if (anomaly_size == 0 && use_weight) {
+        invalid_exit("no anomaly but choose weighted decoding");
+    }
+}
+
 int main(int argc, char *argv[]) {
     // distance
     int d = 11;
@@ -35,13 +35,47 @@ int main(int argc, char *argv[]) {
     // physical error probability of anomalous qubit
     double error_prob_anomaly = 0.5;
 
+    // how to sample error locations
+    ErrorSampler error_sampler = ErrorSampler::Bernoulli;
+
+    // decoder (Union-Find if Blossom V is not built in)
+#ifdef USE_BLOSSOM5
+    DecoderType decoder_type = DecoderType::MWPM;
+#else
+    DecoderType decoder_type = DecoderType::UnionFind;
+#endif
+
+    // number of nearest neighbours in sparse matching graph (0 = complete graph)
+    int sparse_neighbor_count = 0;
+    bool sparse_verify = false;
+
+    // burst error model (disabled by default)
+    BurstModel burst_model;
+
+    // number of worker threads
+    int thread_count = 1;
+
+    // adaptive sampling (trial_count becomes the maximum number of trials)
+    StoppingRule stopping_rule;
+
+    // sweep mode: main sweep <grid file or "key=values" terms> [options]
+    bool sweep_mode = (argc > 1 && string(argv[1]) == "sweep");
+    string sweep_grid;
+    string sweep_output = "sweep.dat";
+    int chunk_size = 1000;
+
     // fix seed when executed without argument
-    int seed = 42;
+    uint64_t seed = 42;
     bool visualize_flag = true;
 
     if (argc > 1) {
 
-        if (argc == 6) {
+        int option_begin = 6;
+        if (sweep_mode) {
+            if (argc < 3) invalid_exit("no grid for sweep");
+            sweep_grid = argv[2];
+            option_begin = 3;
+        } else if (argc >= 6) {
             // parse argument
             d = atoi(argv[1]);
             anomaly_size = atoi(argv[2]);
@@ -56,63 +90,172 @@ int main(int argc, char *argv[]) {
         error_prob_anomaly = 0.5;
 
         // use random seed when executed with argument
-        random_device rd;
-        seed = rd();
+        seed = Random::draw_random_seed();
         visualize_flag = false;
+
+        // parse options
+        for (int i = option_begin; i < argc; i += 2) {
+            string option = argv[i];
+            if (i + 1 >= argc) {
+                invalid_exit("no value for option " + option);
+            }
+            if (option == "--threads") {
+                thread_count = atoi(argv[i + 1]);
+            } else if (option == "--sampler") {
+                string value = argv[i + 1];
+                if (value == "bernoulli") error_sampler = ErrorSampler::Bernoulli;
+                else if (value == "geometric") error_sampler = ErrorSampler::Geometric;
+                else invalid_exit("unknown sampler " + value);
+            } else if (option == "--decoder") {
+                string value = argv[i + 1];
+                if (value == "mwpm") decoder_type = DecoderType::MWPM;
+                else if (value == "uf") decoder_type = DecoderType::UnionFind;
+                else invalid_exit("unknown decoder " + value);
+            } else if (option == "--burst") {
+                // onset,peak_prob,decay,spread
+                burst_model.enabled = true;
+                stringstream value(argv[i + 1]);
+                char comma1 = 0, comma2 = 0, comma3 = 0;
+                value >> burst_model.onset >> comma1 >> burst_model.peak_prob >> comma2 >> burst_model.decay >> comma3 >> burst_model.spread;
+                if (value.fail() || comma1 != ',' || comma2 != ',' || comma3 != ',') invalid_exit("burst must be onset,peak_prob,decay,spread");
+            } else if (option == "--sparse") {
+                sparse_neighbor_count = atoi(argv[i + 1]);
+            } else if (option == "--sparse-verify") {
+                sparse_verify = (atoi(argv[i + 1]) == 1);
+            } else if (option == "--target-rse") {
+                stopping_rule.target_relative_error = atof(argv[i + 1]);
+            } else if (option == "--min-failures") {
+                stopping_rule.min_failures = atoi(argv[i + 1]);
+            } else if (option == "--time-budget") {
+                stopping_rule.time_budget = atof(argv[i + 1]);
+            } else if (option == "--seed") {
+                seed = strtoull(argv[i + 1], nullptr, 10);
+            } else if (option == "--output" && sweep_mode) {
+                sweep_output = argv[i + 1];
+            } else if (option == "--chunk" && sweep_mode) {
+                chunk_size = atoi(argv[i + 1]);
+            } else {
+                invalid_exit("unknown option " + option);
+            }
+        }
     }
-    if (d % 2 == 0) {
-        invalid_exit("code distance is even");
+    if (sparse_neighbor_count < 0) {
+        invalid_exit("sparse neighbour count must be non-negative");
     }
-    if (d <= anomaly_size + 1) {
-        invalid_exit("anomaly_size is too large");
+    if (thread_count < 1) {
+        invalid_exit("thread count must be positive");
     }
-    if (anomaly_size == 0 && use_weight) {
-        invalid_exit("no anomaly but choose weighted decoding");
+    if (stopping_rule.target_relative_error < 0 || stopping_rule.min_failures < 0 || stopping_rule.time_budget < 0) {
+        invalid_exit("stopping criteria must be non-negative");
+    }
+#ifndef USE_BLOSSOM5
+    if (decoder_type == DecoderType::MWPM) {
+        invalid_exit("mwpm decoder requires blossom5");
+    }
+#endif
+    if (burst_model.enabled && (burst_model.peak_prob < 0 || burst_model.peak_prob > 1)) {
+        invalid_exit("peak probability of burst must be in [0,1]");
+    }
+    if (decoder_type == DecoderType::UnionFind && sparse_neighbor_count > 0) {
+        invalid_exit("sparse matching graph is only for mwpm decoder");
     }
 
-    AnomalyInfo anomaly_info(anomaly_size);
-    RecoveryInfo recovery_info(d);
-
-    mt19937 mt(seed);
-    
-
-    // measure error (after xor)(d*d*(d-1))
-    vector<vector<vector<bool>>> syndrome_map(d, vector<vector<bool>>(d, vector<bool>(d-1, false)));
-    // the result of measure (d*d*(d-1))
-    vector<tuple<int, int, int>> syndrome_active_list;
+    if (sweep_mode) {
+        if (stopping_rule.enabled()) {
+            invalid_exit("adaptive sampling is not supported in sweep mode");
+        }
+        if (chunk_size < 1) {
+            invalid_exit("chunk size must be positive");
+        }
+        vector<SweepPoint> points = parse_sweep_grid(sweep_grid);
+        for (const auto &point : points) check_point(point.d, point.anomaly_size, point.use_weight);
 
-    // perform trials
-    clock_t start = clock();
-    int misscount = 0;
-    rep(_, trial_count) {
+        SimulationConfig base_config;
+        base_config.error_prob_anomaly = error_prob_anomaly;
+        base_config.error_sampler = error_sampler;
+        base_config.burst_model = burst_model;
+        base_config.decoder_type = decoder_type;
+        base_config.sparse_neighbor_count = sparse_neighbor_count;
+        base_config.sparse_verify = sparse_verify;
+        base_config.visualize_flag = false;
 
-        int error_seed = mt();
+        auto start = chrono::steady_clock::now();
+        vector<TrialResult> results = run_sweep(points, base_config, seed, thread_count, chunk_size);
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-        bool error_parity = make_error(error_seed, d, anomaly_info, syndrome_active_list, syndrome_map, error_prob, error_prob_anomaly);
+        // one line per point
+        fstream ofs(sweep_output, ios::out);
+        ofs << "# d anomaly_size use_weight error_prob decoder trial_count failure_count logical_error_rate wilson95_low wilson95_high" << endl;
+        rep(i, points.size()) {
+            const SweepPoint &point = points[i];
+            const TrialResult &result = results[i];
+            pair<double, double> interval = wilson_interval(result.misscount, result.trial_count, 1.96);
+            ofs << point.d << " " << point.anomaly_size << " " << point.use_weight << " " << point.error_prob << " "
+                << ((decoder_type == DecoderType::UnionFind) ? "uf" : "mwpm") << " "
+                << result.trial_count << " " << result.misscount << " " << ((double)result.misscount) / ((double)result.trial_count) << " "
+                << interval.first << " " << interval.second << endl;
+        }
+        ofs.close();
+        cout << points.size() << " points are saved in " << sweep_output << endl;
+        cout << "elapsed " << elapsed << " sec" << endl;
+        return 0;
+    }
+    check_point(d, anomaly_size, use_weight);
 
-        if (use_weight)
-            correction_weighted(d, recovery_info, syndrome_active_list, anomaly_info);
-        else
-            correction_uniform(d, recovery_info, syndrome_active_list);
+    SimulationConfig config;
+    config.d = d;
+    config.anomaly_size = anomaly_size;
+    config.use_weight = use_weight;
+    config.error_prob = error_prob;
+    config.error_prob_anomaly = error_prob_anomaly;
+    config.error_sampler = error_sampler;
+    config.burst_model = burst_model;
+    if (burst_model.enabled) config.burst_model.prepare(d, error_prob);
+    config.decoder_type = decoder_type;
+    config.sparse_neighbor_count = sparse_neighbor_count;
+    config.sparse_verify = sparse_verify;
+    config.visualize_flag = visualize_flag;
 
-        bool recovery_parity = check(d, recovery_info);
+    // perform trials
+    auto start = chrono::steady_clock::now();
+    TrialResult result;
+    string stop_reason;
+    if (stopping_rule.enabled())
+        result = run_trials_adaptive(config, seed, trial_count, thread_count, stopping_rule, stop_reason);
+    else
+        result = run_trials_parallel(config, seed, trial_count, thread_count);
+    double logical_error_rate = ((double)result.misscount) / ((double)result.trial_count);
+    auto end = chrono::steady_clock::now();
+    double elapsed = chrono::duration<double>(end - start).count();
+    // 95% confidence interval
+    pair<double, double> interval = wilson_interval(result.misscount, result.trial_count, 1.96);
 
-        if (recovery_parity != error_parity)
-            misscount++;
+    // output to file
+    stringstream config_name;
+    config_name << d << "_" << anomaly_size << "_" << use_weight << "_" << error_prob;
+    // results of Union-Find decoder are kept apart from those of mwpm
+    if (decoder_type == DecoderType::UnionFind) config_name << "_uf";
+    if (burst_model.enabled) config_name << "_burst";
+    fstream ofs("result_" + config_name.str() + ".txt", ios::app);
+    ofs << result.trial_count << " " << logical_error_rate << endl;
+    cout << result.trial_count << " " << logical_error_rate << endl;
+    ofs.close();
+    cout << "wilson95 " << interval.first << " " << interval.second << endl;
 
-        if ((recovery_parity != error_parity) && visualize_flag)
-            visualize(d, recovery_info, syndrome_map);
+    // in adaptive mode, confidence intervals are saved in another file so that result_*.txt keeps its format
+    if (stopping_rule.enabled()) {
+        fstream ofs_interval("wilson_" + config_name.str() + ".dat", ios::app);
+        ofs_interval << result.trial_count << " " << result.misscount << " " << logical_error_rate << " "
+                     << interval.first << " " << interval.second << " " << stop_reason << endl;
+        ofs_interval.close();
+        cout << "stop " << stop_reason << " failures " << result.misscount << endl;
     }
-    double logical_error_rate = ((double)misscount) / ((double)trial_count);
-    clock_t end = clock();
 
-    // output to file
-    stringstream ss;
-    ss << "result_" << d << "_" << anomaly_size << "_" << use_weight << "_" << error_prob << ".txt";
-    fstream ofs(ss.str(), ios::app);
-    ofs << trial_count << " " << logical_error_rate << endl;
-    cout << trial_count << " " << logical_error_rate << endl;
-    ofs.close();
+    if (sparse_neighbor_count > 0 && sparse_verify) {
+        cout << "sparse_mismatch " << result.sparse_mismatch_count << " " << ((double)result.sparse_mismatch_count) / ((double)result.trial_count) << endl;
+    }
+    // wall-clock throughput for comparing decoders
+    cout << "elapsed " << elapsed << " sec, " << ((double)result.trial_count) / elapsed << " trials/sec" << endl;
 
     return 0;
 }
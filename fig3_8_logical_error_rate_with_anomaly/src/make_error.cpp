@@ -6,6 +6,7 @@
 /*
 Generate errors with randomly placed anomalous region
  we do not incur anomalous region when anomalous_size = 0
+ with burst model, the anomalous region only gives the center of burst, and the error rates follow the model
 
 Coordinate of errors
 
@@ -50,108 +51,260 @@ Coordinate of errors
  | | | |
 -.-.-.-.- 4
 */
-bool make_error(
-    int seed, int d,
-    AnomalyInfo &anomaly_info,
 
-    vector<tuple<int, int, int>> &syndrome_active_list,
-    vector<vector<vector<bool>>> &syndrome_map,
-    double error_prob,
-    double error_prob_anomaly) {
+// anomalous region for each type of error location
+static inline bool is_anomalous_horizontal(const AnomalyInfo &anomaly_info, int y, int x) {
+    const int ay = anomaly_info.anomaly_y;
+    const int ax = anomaly_info.anomaly_x;
+    const int as = anomaly_info.anomaly_size;
+    return (as > 0) && (ay <= y) && (y < (ay + as)) && (ax <= x) && (x <= (ax + as));
+}
+static inline bool is_anomalous_vertical(const AnomalyInfo &anomaly_info, int y, int x) {
+    const int ay = anomaly_info.anomaly_y;
+    const int ax = anomaly_info.anomaly_x;
+    const int as = anomaly_info.anomaly_size;
+    return (as > 0) && (ay <= y) && (y <= (ay + as)) && (ax <= (x - 1)) && ((x - 1) < (ax + as));
+}
+static inline bool is_anomalous_meas(const AnomalyInfo &anomaly_info, int y, int x) {
+    const int ay = anomaly_info.anomaly_y;
+    const int ax = anomaly_info.anomaly_x;
+    const int as = anomaly_info.anomaly_size;
+    return (as > 0) && (ay <= y) && (y <= (ay + as)) && (ax <= x) && (x <= (ax + as));
+}
 
-    mt19937 mt(seed);
-    uniform_real_distribution<> rnd(0.0, 1.0);
+// draw the gaps between successive errors of a Bernoulli process with probability p
+//  the gap follows the geometric distribution floor(log(u)/log(1-p)), u in (0,1]
+class GeometricSkip {
+   public:
+    GeometricSkip(double p) : always(p >= 1.0), never(p <= 0.0), log_q((p > 0.0 && p < 1.0) ? log1p(-p) : 0.0) {}
+    // return the index of the next error after the location `current`
+    long long next(Random &random, uniform_real_distribution<> &rnd, long long current) const {
+        if (always) return current + 1;
+        if (never) return numeric_limits<long long>::max();
+        double gap = floor(log(1.0 - rnd(random)) / log_q);
+        if (gap >= (double)(numeric_limits<long long>::max() / 2)) return numeric_limits<long long>::max();
+        return current + 1 + (long long)gap;
+    }
+
+   private:
+    bool always;
+    bool never;
+    double log_q;
+};
+
+// inject errors of cycle z by drawing one random number per location
+static void inject_error_bernoulli(
+    int z, int d, const AnomalyInfo &anomaly_info, ErrorWorkspace &error_workspace,
+    Random &random, uniform_real_distribution<> &rnd, double error_prob, double error_prob_anomaly) {
+
+    // horizontal qubit error
+    rep(y, d - 1) {
+        uint64_t *row = error_workspace.error_horizontal.row(y + 1);
+        rep(x, d - 1) {
+            double current_error_prob = is_anomalous_horizontal(anomaly_info, y, x) ? error_prob_anomaly : error_prob;
+            if (rnd(random) < current_error_prob) {
+                row[x >> 6] ^= (1ULL << (x & 63));
+            }
+        }
+    }
+    // vertical qubit error
+    rep(y, d) {
+        uint64_t *row = error_workspace.error_vertical.row(y);
+        rep(x, d) {
+            double current_error_prob = is_anomalous_vertical(anomaly_info, y, x) ? error_prob_anomaly : error_prob;
+            if (rnd(random) < current_error_prob) {
+                row[x >> 6] ^= (1ULL << (x & 63));
+            }
+        }
+    }
+    // measurement error (if not the last cycle)
+    if (z < (d - 1)) {
+        rep(y, d) {
+            uint64_t *row = error_workspace.meas_error.row(y);
+            rep(x, d - 1) {
+                double current_error_prob = is_anomalous_meas(anomaly_info, y, x) ? error_prob_anomaly : error_prob;
+                if (rnd(random) < current_error_prob) {
+                    row[x >> 6] ^= (1ULL << (x & 63));
+                }
+            }
+        }
+    }
+}
+
+// inject errors of cycle z in the anomalous region, where the error rate is high and every location is drawn
+static void inject_error_anomaly_region(
+    int z, int d, const AnomalyInfo &anomaly_info, ErrorWorkspace &error_workspace,
+    Random &random, uniform_real_distribution<> &rnd, double error_prob_anomaly) {
+
+    const int ay = anomaly_info.anomaly_y;
+    const int ax = anomaly_info.anomaly_x;
+    const int as = anomaly_info.anomaly_size;
+    if (as == 0) return;
+
+    rep2(y, ay, ay + as) rep2(x, ax, ax + as + 1) {
+        if (rnd(random) < error_prob_anomaly) error_workspace.error_horizontal.flip(y + 1, x);
+    }
+    rep2(y, ay, ay + as + 1) rep2(x, ax + 1, ax + as + 1) {
+        if (rnd(random) < error_prob_anomaly) error_workspace.error_vertical.flip(y, x);
+    }
+    if (z < (d - 1)) {
+        rep2(y, ay, ay + as + 1) rep2(x, ax, ax + as + 1) {
+            if (rnd(random) < error_prob_anomaly) error_workspace.meas_error.flip(y, x);
+        }
+    }
+}
 
+void BurstModel::prepare(int d, double error_prob) {
+    map_offset = 2 * d;
+    map_width = 4 * d + 1;
+    prob_map.resize((size_t)d * map_width * map_width);
+    rep(t, d) {
+        double temporal = peak_prob * ((decay > 0) ? exp(-t / decay) : 1.0);
+        rep(i, map_width) rep(j, map_width) {
+            // offsets in doubled coordinates
+            double dy = (i - map_offset) * 0.5;
+            double dx = (j - map_offset) * 0.5;
+            double r2 = dy * dy + dx * dx;
+            double spatial = (spread > 0) ? exp(-r2 / (2 * spread * spread)) : ((r2 == 0) ? 1.0 : 0.0);
+            prob_map[((size_t)t * map_width + i) * map_width + j] = error_prob + (1 - error_prob) * temporal * spatial;
+        }
+    }
+}
+
+// inject errors of cycle z, t cycles after the onset of burst centered at (center_y2, center_x2) in doubled coordinates
+//  error probabilities are read from the precomputed map, and error bits are set without branches
+static void inject_error_burst(
+    int z, int t, int d, int center_y2, int center_x2, const BurstModel &burst_model,
+    ErrorWorkspace &error_workspace, Random &random, uniform_real_distribution<> &rnd) {
+
+    const double *map = burst_model.cycle_map(t);
+    const int width = burst_model.map_width;
+    const int offset = burst_model.map_offset;
 
-    // measure error (before xor)(d*(d-1))
-    vector<vector<bool>> meas_value_temp(d, vector<bool>(d - 1, false));
+    // horizontal qubit (y,x) is at (2y+1,2x)
+    rep(y, d - 1) {
+        uint64_t *row = error_workspace.error_horizontal.row(y + 1);
+        const double *line = map + (size_t)(2 * y + 1 - center_y2 + offset) * width + (offset - center_x2);
+        rep(x, d - 1) row[x >> 6] ^= ((uint64_t)(rnd(random) < line[2 * x])) << (x & 63);
+    }
+    // vertical qubit (y,x) is at (2y,2x-1)
+    rep(y, d) {
+        uint64_t *row = error_workspace.error_vertical.row(y);
+        const double *line = map + (size_t)(2 * y - center_y2 + offset) * width + (offset - center_x2);
+        rep(x, d) row[x >> 6] ^= ((uint64_t)(rnd(random) < line[2 * x - 1])) << (x & 63);
+    }
+    // measurement (y,x) is at (2y,2x)
+    if (z < (d - 1)) {
+        rep(y, d) {
+            uint64_t *row = error_workspace.meas_error.row(y);
+            const double *line = map + (size_t)(2 * y - center_y2 + offset) * width + (offset - center_x2);
+            rep(x, d - 1) row[x >> 6] ^= ((uint64_t)(rnd(random) < line[2 * x])) << (x & 63);
+        }
+    }
+}
 
-    // measure error (after xor)(d*(d-1))
-    vector<vector<bool>> meas_value_xor(d, vector<bool>(d-1, false));
+bool make_error(
+    Random &random, int d,
+    AnomalyInfo &anomaly_info,
+    ErrorWorkspace &error_workspace,
+    vector<tuple<int, int, int>> &syndrome_active_list,
+    BitLattice &syndrome_map,
+    double error_prob,
+    double error_prob_anomaly,
+    ErrorSampler error_sampler,
+    const BurstModel &burst_model) {
 
-    // horizontal qubit ((d+1)*(d-1))  y\in {0,n} is dummy.
-    vector<vector<bool>> error_horizontal(d+1, vector<bool>(d - 1, false));
+    uniform_real_distribution<> rnd(0.0, 1.0);
 
-    // vertical qubit (d*d)
-    vector<vector<bool>> error_vertical(d, vector<bool>(d, false));
+    BitLattice &meas_value_prev = error_workspace.meas_value_prev;
+    BitLattice &meas_error = error_workspace.meas_error;
+    BitLattice &error_horizontal = error_workspace.error_horizontal;
+    BitLattice &error_vertical = error_workspace.error_vertical;
+    meas_value_prev.clear();
+    error_horizontal.clear();
+    error_vertical.clear();
 
+    anomaly_info.anomaly_y = random() % (d - anomaly_info.anomaly_size);
+    anomaly_info.anomaly_x = random() % (d - anomaly_info.anomaly_size - 1);
 
-    anomaly_info.anomaly_y = mt() % (d - anomaly_info.anomaly_size);
-    anomaly_info.anomaly_x = mt() % (d - anomaly_info.anomaly_size - 1);
+    // burst is centered at the center of anomalous region, and the static anomalous region is not used
+    const AnomalyInfo no_anomaly(0);
+    const AnomalyInfo &static_anomaly = burst_model.enabled ? no_anomaly : anomaly_info;
+    int burst_onset = d;
+    if (burst_model.enabled) burst_onset = (burst_model.onset >= 0) ? burst_model.onset : (int)(random() % d);
+    const int center_y2 = 2 * anomaly_info.anomaly_y + anomaly_info.anomaly_size;
+    const int center_x2 = 2 * anomaly_info.anomaly_x + anomaly_info.anomaly_size;
 
-    rep(z, d) rep(y, d) rep(x, d - 1) syndrome_map[z][y][x] = false;
+    // every row of syndrome_map is overwritten below, so we do not need to clear it
     syndrome_active_list.clear();
 
+    // In the geometric-skip sampler, the error locations of all cycles are flattened as
+    //  [horizontal (d-1)*(d-1)][vertical d*d][measurement d*(d-1)] per cycle,
+    //  and we jump from an error to the next one. Hits in the anomalous region are discarded,
+    //  since the region is sampled separately with its own error rate.
+    const long long num_horizontal = (long long)(d - 1) * (d - 1);
+    const long long num_vertical = (long long)d * d;
+    const long long num_meas = (long long)d * (d - 1);
+    const long long cycle_stride = num_horizontal + num_vertical + num_meas;
+    GeometricSkip skip(error_prob);
+    long long next_error = -1;
+    if (error_sampler == ErrorSampler::Geometric) next_error = skip.next(random, rnd, next_error);
+
     // iterate cycle
     rep(z, d) {
-        // refresh measurement
-        rep(y, d) {
-            rep(x, d - 1) {
-                meas_value_xor[y][x] = meas_value_temp[y][x];
-                meas_value_temp[y][x] = false;
-            }
-        }
-        // horizontal qubit error
-        rep(y, d - 1) {
-            rep(x, d - 1) {
-                bool is_anomalous = (anomaly_info.anomaly_y <= y) && (y < (anomaly_info.anomaly_y + anomaly_info.anomaly_size)) && (anomaly_info.anomaly_x <= x) && (x <= (anomaly_info.anomaly_x + anomaly_info.anomaly_size));
-                is_anomalous = is_anomalous & (anomaly_info.anomaly_size > 0);
-                double random_value = rnd(mt);
-                double current_error_prob = is_anomalous ? error_prob_anomaly : error_prob;
-                if (random_value < current_error_prob) {
-                    error_horizontal[y + 1][x] = (!error_horizontal[y + 1][x]);
-                    // cout << "| " << z << " " << y + 1 << " " << x << endl;
-                }
-            }
-        }
-        // vertical qubit error
-        rep(y, d) {
-            rep(x, d) {
-                bool is_anomalous = (anomaly_info.anomaly_y <= y) && (y <= (anomaly_info.anomaly_y + anomaly_info.anomaly_size)) && (anomaly_info.anomaly_x <= (x - 1)) && ((x - 1) < (anomaly_info.anomaly_x + anomaly_info.anomaly_size));
-                is_anomalous = is_anomalous & (anomaly_info.anomaly_size > 0);
-                double random_value = rnd(mt);
-                double current_error_prob = is_anomalous ? error_prob_anomaly : error_prob;
-                if (random_value < current_error_prob) {
-                    error_vertical[y][x] = (!error_vertical[y][x]);
-                    // cout << "- " << z << " " << y << " " << x << endl;
+        meas_error.clear();
+        if (z >= burst_onset) {
+            inject_error_burst(z, z - burst_onset, d, center_y2, center_x2, burst_model, error_workspace, random, rnd);
+            // gaps are memoryless, so the geometric sampler restarts from the end of this cycle
+            const long long cycle_end = (z + 1) * cycle_stride;
+            if (error_sampler == ErrorSampler::Geometric && next_error < cycle_end) next_error = skip.next(random, rnd, cycle_end - 1);
+        } else if (error_sampler == ErrorSampler::Bernoulli) {
+            inject_error_bernoulli(z, d, static_anomaly, error_workspace, random, rnd, error_prob, error_prob_anomaly);
+        } else {
+            const long long cycle_end = (z + 1) * cycle_stride;
+            for (; next_error < cycle_end; next_error = skip.next(random, rnd, next_error)) {
+                long long local = next_error - z * cycle_stride;
+                if (local < num_horizontal) {
+                    int y = (int)(local / (d - 1));
+                    int x = (int)(local % (d - 1));
+                    if (!is_anomalous_horizontal(static_anomaly, y, x)) error_horizontal.flip(y + 1, x);
+                } else if (local < num_horizontal + num_vertical) {
+                    local -= num_horizontal;
+                    int y = (int)(local / d);
+                    int x = (int)(local % d);
+                    if (!is_anomalous_vertical(static_anomaly, y, x)) error_vertical.flip(y, x);
+                } else if (z < (d - 1)) {
+                    local -= num_horizontal + num_vertical;
+                    int y = (int)(local / (d - 1));
+                    int x = (int)(local % (d - 1));
+                    if (!is_anomalous_meas(static_anomaly, y, x)) meas_error.flip(y, x);
                 }
             }
+            inject_error_anomaly_region(z, d, static_anomaly, error_workspace, random, rnd, error_prob_anomaly);
         }
 
         // measurement with error
         rep(y, d) {
-            rep(x, d - 1) {
-                // gather parity
-                bool parity = false;
-                if (error_horizontal[y][x])
-                    parity = (!parity);
-                if (error_horizontal[y + 1][x])
-                    parity = (!parity);
-                if (error_vertical[y][x])
-                    parity = (!parity);
-                if (error_vertical[y][x + 1])
-                    parity = (!parity);
-
-                // if not the last cycle, consider measurement error
-                if (z < (d - 1)) {
-                    bool is_anomalous = (anomaly_info.anomaly_y <= y) && (y <= (anomaly_info.anomaly_y + anomaly_info.anomaly_size)) && (anomaly_info.anomaly_x <= x) && (x <= (anomaly_info.anomaly_x + anomaly_info.anomaly_size));
-                    is_anomalous = is_anomalous & (anomaly_info.anomaly_size > 0);
-                    double random_value = rnd(mt);
-                    double current_error_prob = is_anomalous ? error_prob_anomaly : error_prob;
-                    if (random_value < current_error_prob) {
-                        parity = (!parity);
-                        // cout << ". " << z << " " << y << " " << x << endl;
-                    }
-                }
+            const uint64_t *upper = error_horizontal.row(y);
+            const uint64_t *lower = error_horizontal.row(y + 1);
+            const uint64_t *side = error_vertical.row(y);
+            const uint64_t *err = meas_error.row(y);
+            uint64_t *prev = meas_value_prev.row(y);
+            uint64_t *synd = syndrome_map.row(z, y);
+            rep(w, meas_value_prev.words_per_row) {
+                // gather parity of error_horizontal[y][x], error_horizontal[y+1][x], error_vertical[y][x], error_vertical[y][x+1]
+                uint64_t parity = upper[w] ^ lower[w] ^ side[w] ^ error_vertical.shifted_word(side, w);
+                uint64_t value = (parity ^ err[w]) & meas_value_prev.word_mask(w);
 
-                // process error
-                if (parity) {
-                    meas_value_xor[y][x] = (!meas_value_xor[y][x]);
-                    meas_value_temp[y][x] = (!meas_value_temp[y][x]);
-                }
-                if (meas_value_xor[y][x]) {
+                // syndrome is the xor of consecutive measurements
+                synd[w] = prev[w] ^ value;
+                prev[w] = value;
+
+                uint64_t active = synd[w];
+                while (active) {
+                    int x = w * 64 + count_trailing_zeros(active);
                     syndrome_active_list.push_back({z, y, x});
-                    syndrome_map[z][y][x] = true;
+                    active &= active - 1;
                 }
             }
         }
@@ -159,7 +312,7 @@ bool make_error(
 
     // calculate left-boundary parity
     bool error_parity = false;
-    rep(y, d) if (error_vertical[y][0]) error_parity = (!error_parity);
+    rep(y, d) if (error_vertical.get(y, 0)) error_parity = (!error_parity);
 
     return error_parity;
-}
\ No newline at end of file
+}
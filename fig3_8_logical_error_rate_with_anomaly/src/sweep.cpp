@@ -0,0 +1,137 @@
+// Copyright 2022 NTT CORPORATION
+
+#include "common.hpp"
+
+/*
+A grid is given as lines of "key=values" terms, and each line is expanded into the cartesian product of values.
+
+    d=9,15,21 a=0,4 w=0 n=100000 p=0.004:0.04:20
+
+- d: code distance, a: anomaly size, w: use weight (0 or 1), n: trial count, p: physical error probability
+- values are separated by comma, and "lo:hi:num" for p gives num log-spaced values from lo to hi (as np.logspace)
+- '#' starts a comment
+*/
+
+static vector<double> parse_values(const string &key, const string &text) {
+    vector<double> values;
+    size_t colon = text.find(':');
+    if (colon != string::npos) {
+        size_t colon2 = text.find(':', colon + 1);
+        if (colon2 == string::npos) throw runtime_error("invalid range " + key + "=" + text);
+        double lo = atof(text.substr(0, colon).c_str());
+        double hi = atof(text.substr(colon + 1, colon2 - colon - 1).c_str());
+        int num = atoi(text.substr(colon2 + 1).c_str());
+        if (lo <= 0 || hi <= 0 || num < 1) throw runtime_error("invalid range " + key + "=" + text);
+        rep(i, num) {
+            double ratio = (num == 1) ? 0. : ((double)i) / (num - 1);
+            values.push_back(exp(log(lo) + (log(hi) - log(lo)) * ratio));
+        }
+        return values;
+    }
+    stringstream ss(text);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item.size() > 0) values.push_back(atof(item.c_str()));
+    }
+    if (values.size() == 0) throw runtime_error("no value for " + key);
+    return values;
+}
+
+static void append_grid_line(const string &line, vector<SweepPoint> &points) {
+    vector<double> ds, as, ws, ns, ps;
+    stringstream ss(line.substr(0, line.find('#')));
+    string term;
+    bool has_term = false;
+    while (ss >> term) {
+        has_term = true;
+        size_t eq = term.find('=');
+        if (eq == string::npos) throw runtime_error("invalid grid term " + term);
+        string key = term.substr(0, eq);
+        vector<double> values = parse_values(key, term.substr(eq + 1));
+        if (key == "d") ds = values;
+        else if (key == "a") as = values;
+        else if (key == "w") ws = values;
+        else if (key == "n") ns = values;
+        else if (key == "p") ps = values;
+        else throw runtime_error("unknown grid key " + key);
+    }
+    if (!has_term) return;
+    if (ds.empty() || as.empty() || ws.empty() || ns.empty() || ps.empty())
+        throw runtime_error("grid line must have all of d, a, w, n, and p: " + line);
+    for (double d : ds) for (double a : as) for (double w : ws) for (double n : ns) for (double p : ps) {
+        points.push_back({(int)d, (int)a, ((int)w) == 1, (int)n, p});
+    }
+}
+
+vector<SweepPoint> parse_sweep_grid(const string &grid) {
+    vector<SweepPoint> points;
+    if (grid.find('=') != string::npos) {
+        // inline grid
+        append_grid_line(grid, points);
+    } else {
+        ifstream ifs(grid);
+        if (!ifs) throw runtime_error("cannot open grid file " + grid);
+        string line;
+        while (getline(ifs, line)) append_grid_line(line, points);
+    }
+    if (points.size() == 0) throw runtime_error("empty grid " + grid);
+    return points;
+}
+
+vector<TrialResult> run_sweep(const vector<SweepPoint> &points, const SimulationConfig &base_config, uint64_t seed, int thread_count, int chunk_size) {
+    const int point_count = (int)points.size();
+    vector<SimulationConfig> configs(point_count, base_config);
+    rep(i, point_count) {
+        configs[i].d = points[i].d;
+        configs[i].anomaly_size = points[i].anomaly_size;
+        configs[i].use_weight = points[i].use_weight;
+        configs[i].error_prob = points[i].error_prob;
+        if (configs[i].burst_model.enabled) configs[i].burst_model.prepare(points[i].d, points[i].error_prob);
+    }
+
+    // split every point into chunks of trials, where each trial has its own substream of the seed of the point
+    //  so that the result only depends on seed, not on chunk_size or scheduling
+    vector<uint64_t> point_seed(point_count);
+    rep(i, point_count) point_seed[i] = Random(seed, i).next();
+    struct Task {
+        int point;
+        int first_trial;
+        int trial_count;
+    };
+    vector<Task> tasks;
+    rep(i, point_count) {
+        for (int done = 0; done < points[i].trial_count; done += chunk_size) {
+            tasks.push_back({i, done, min(chunk_size, points[i].trial_count - done)});
+        }
+    }
+
+    // idle workers take the next chunk from the shared queue, so every thread is busy until the last chunk
+    vector<TrialResult> task_result(tasks.size());
+    atomic<size_t> next_task(0);
+    auto work = [&]() {
+        unique_ptr<TrialWorker> worker;
+        int worker_point = -1;
+        while (true) {
+            size_t t = next_task.fetch_add(1);
+            if (t >= tasks.size()) break;
+            const Task &task = tasks[t];
+            // buffers are reused while consecutive chunks belong to the same point
+            if (task.point != worker_point) {
+                worker.reset(new TrialWorker(configs[task.point], point_seed[task.point]));
+                worker_point = task.point;
+            }
+            task_result[t] = worker->run(task.first_trial, task.trial_count);
+        }
+    };
+    if (thread_count == 1) {
+        work();
+    } else {
+        vector<thread> threads;
+        rep(t, thread_count) threads.emplace_back(work);
+        for (auto &th : threads) th.join();
+    }
+
+    vector<TrialResult> result(point_count);
+    rep(t, tasks.size()) result[tasks[t].point].add(task_result[t]);
+    return result;
+}
@@ -0,0 +1,147 @@
+// Copyright 2022 NTT CORPORATION
+
+#include "common.hpp"
+
+
+TrialWorker::TrialWorker(const SimulationConfig &_config, uint64_t _seed)
+    : config(_config),
+      anomaly_info(_config.anomaly_size),
+      recovery_info(_config.d),
+      error_workspace(_config.d),
+      syndrome_map(_config.d, _config.d, _config.d - 1),
+      seed(_seed),
+      random(_seed) {
+    decoder_context.reserve(4 * _config.d);
+    if (_config.decoder_type == DecoderType::UnionFind) union_find_context.resize(_config.d);
+}
+
+bool TrialWorker::decode(int sparse_neighbor_count, bool fill_recovery) {
+    if (config.decoder_type == DecoderType::UnionFind)
+        return correction_union_find(config.d, recovery_info, syndrome_active_list, anomaly_info, config.use_weight, union_find_context, fill_recovery);
+    decoder_context.sparse_neighbor_count = sparse_neighbor_count;
+    if (config.use_weight)
+        return correction_weighted(config.d, recovery_info, syndrome_active_list, anomaly_info, decoder_context, fill_recovery);
+    else
+        return correction_uniform(config.d, recovery_info, syndrome_active_list, decoder_context, fill_recovery);
+}
+
+TrialResult TrialWorker::run(int first_trial, int trial_count) {
+    const int d = config.d;
+    TrialResult result;
+    rep(t, trial_count) {
+
+        random.set_stream(seed, (uint64_t)first_trial + t);
+
+        bool error_parity = make_error(random, d, anomaly_info, error_workspace, syndrome_active_list, syndrome_map, config.error_prob, config.error_prob_anomaly, config.error_sampler, config.burst_model);
+
+        // decode with complete graph first if we compare it with sparse graph
+        bool dense_parity = false;
+        bool verify = (config.sparse_neighbor_count > 0 && config.sparse_verify);
+        if (verify)
+            dense_parity = decode(0, false);
+
+        // the recovery volume is needed only for visualization
+        bool recovery_parity = decode(config.sparse_neighbor_count, config.visualize_flag);
+
+        if (verify && (recovery_parity != dense_parity))
+            result.sparse_mismatch_count++;
+
+        result.trial_count++;
+        if (recovery_parity != error_parity)
+            result.misscount++;
+
+        if ((recovery_parity != error_parity) && config.visualize_flag)
+            visualize(d, recovery_info, syndrome_map);
+    }
+    return result;
+}
+
+TrialResult run_trials_parallel(const SimulationConfig &config, uint64_t seed, int trial_count, int thread_count, int first_trial) {
+    // static split of trials; the first (trial_count % thread_count) workers take one extra trial
+    vector<int> worker_first(thread_count + 1, first_trial);
+    rep(t, thread_count) worker_first[t + 1] = worker_first[t] + trial_count / thread_count + ((t < trial_count % thread_count) ? 1 : 0);
+
+    vector<TrialResult> worker_result(thread_count);
+    if (thread_count == 1) {
+        TrialWorker worker(config, seed);
+        worker_result[0] = worker.run(worker_first[0], trial_count);
+    } else {
+        vector<thread> threads;
+        rep(t, thread_count) {
+            threads.emplace_back([&, t]() {
+                TrialWorker worker(config, seed);
+                worker_result[t] = worker.run(worker_first[t], worker_first[t + 1] - worker_first[t]);
+            });
+        }
+        for (auto &th : threads) th.join();
+    }
+
+    TrialResult result;
+    rep(t, thread_count) result.add(worker_result[t]);
+    return result;
+}
+
+TrialResult run_trials_adaptive(const SimulationConfig &config, uint64_t seed, int max_trial_count, int thread_count, const StoppingRule &rule, string &stop_reason) {
+    auto start = chrono::steady_clock::now();
+    // batches continue the trial indices, so that the first n trials are the same as those of run_trials_parallel
+    TrialResult result;
+    int batch_size = 1000;
+    stop_reason = "max_trials";
+    while (result.trial_count < max_trial_count) {
+        int batch_count = min(batch_size, max_trial_count - result.trial_count);
+
+        // shrink the batch to the trials that the observed failure rate predicts are still needed, with a safety margin
+        if (result.misscount > 0) {
+            double rate = ((double)result.misscount) / ((double)result.trial_count);
+            double needed = numeric_limits<double>::infinity();
+            if (rule.min_failures > 0)
+                needed = min(needed, (rule.min_failures - result.misscount) / rate);
+            if (rule.target_relative_error > 0)
+                needed = min(needed, (1 - rate) / (rate * rule.target_relative_error * rule.target_relative_error) - result.trial_count);
+            if (needed < batch_count) {
+                double safety_factor = 1.1;
+                batch_count = max(thread_count, (int)ceil(needed * safety_factor));
+                batch_count = min(batch_count, max_trial_count - result.trial_count);
+            }
+        }
+
+        // shrink the batch so that it will finish within the remaining time
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (rule.time_budget > 0 && result.trial_count > 0 && elapsed > 0) {
+            double expected = (double)result.trial_count / elapsed * (rule.time_budget - elapsed);
+            batch_count = max(1, (int)min((double)batch_count, expected));
+        }
+
+        result.add(run_trials_parallel(config, seed, batch_count, thread_count, result.trial_count));
+        if (batch_size <= numeric_limits<int>::max() / 2) batch_size *= 2;
+
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double rate = ((double)result.misscount) / ((double)result.trial_count);
+        double relative_error = sqrt((1 - rate) / ((double)result.trial_count * rate));
+        if (rule.min_failures > 0 && result.misscount >= rule.min_failures) {
+            stop_reason = "min_failures";
+            break;
+        }
+        if (rule.target_relative_error > 0 && result.misscount > 0 && relative_error <= rule.target_relative_error) {
+            stop_reason = "target_relative_error";
+            break;
+        }
+        if (rule.time_budget > 0 && elapsed >= rule.time_budget) {
+            stop_reason = "time_budget";
+            break;
+        }
+    }
+    return result;
+}
+
+pair<double, double> wilson_interval(int failure_count, int trial_count, double z) {
+    if (trial_count == 0) return {0., 1.};
+    double n = (double)trial_count;
+    double p = ((double)failure_count) / n;
+    double denominator = 1 + z * z / n;
+    double center = (p + z * z / (2 * n)) / denominator;
+    double half_width = z / denominator * sqrt(p * (1 - p) / n + z * z / (4 * n * n));
+    double lower = (failure_count == 0) ? 0. : max(0., center - half_width);
+    double upper = (failure_count == trial_count) ? 1. : min(1., center + half_width);
+    return {lower, upper};
+}
@@ -6,7 +6,7 @@
 void visualize(
     int d,
     const RecoveryInfo &recovery_info,
-    const vector<vector<vector<bool>>> &syndrome_map) {
+    const BitLattice &syndrome_map) {
     int y;
     cout << endl;
     rep(z, d) {
@@ -20,7 +20,7 @@ void visualize(
                         cout << "-";
                     else
                         cout << ".";
-                    if (syndrome_map[z][y][x])
+                    if (syndrome_map.get(z, y, x))
                         cout << "O";
                     else
                         cout << " ";
@@ -0,0 +1,92 @@
+# Copyright 2022 NTT CORPORATION
+
+import glob
+import os
+import pickle
+from typing import Tuple
+import numpy as np
+
+# layout of TrajectoryHeader in generator/src/trajectory_writer.hpp
+header_dtype = np.dtype([
+    ("magic", "S8"),
+    ("version", "<u4"),
+    ("header_size", "<u4"),
+    ("distance", "<u4"),
+    ("num_layer", "<u4"),
+    ("num_node_layer", "<u4"),
+    ("row_bytes", "<u4"),
+    ("num_lattice", "<u4"),
+    ("width_x", "<u4"),
+    ("width_z", "<u4"),
+    ("trial_count", "<u4"),
+    ("anomaly_size", "<i4"),
+    ("anomaly_center", "<i4"),
+    ("anomaly_layer_begin", "<u4"),
+    ("anomaly_layer_end", "<u4"),
+    ("error_prob", "<f8"),
+    ("anomaly_ratio", "<f8"),
+])
+
+
+def open_trajectory(fname: str) -> Tuple[np.void, np.memmap]:
+    """Open a binary trajectory file without loading it
+
+    Args:
+        fname (str): file name of binary trajectory (*.bin)
+
+    Returns:
+        Tuple[np.void, np.memmap]: pair of header and packed syndromes.
+            Packed syndromes have shape (trial, lattice (X, Z), layer, row_bytes).
+            The number of trials is calculated from the file size, so that a file being written can be opened.
+    """
+    header = np.fromfile(fname, dtype=header_dtype, count=1)[0]
+    assert header["magic"] == b"Q3DETRJ", f"{fname} is not a trajectory file"
+    shape = (int(header["num_lattice"]), int(header["num_layer"]), int(header["row_bytes"]))
+    trial_bytes = shape[0] * shape[1] * shape[2]
+    num_trial = (os.path.getsize(fname) - int(header["header_size"])) // trial_bytes
+    packed = np.memmap(fname, dtype=np.uint8, mode="r", offset=int(header["header_size"]), shape=(num_trial,) + shape)
+    return header, packed
+
+
+def load_trajectory(fname: str, num_sample: int, num_synd: int) -> np.ndarray:
+    """Load syndromes of trajectory file
+
+    Args:
+        fname (str): file name of binary trajectory (*.bin) or text trajectory (*.txt)
+        num_sample (int): number of trials, used for text trajectory
+        num_synd (int): number of syndrome nodes per layer, used for text trajectory
+
+    Returns:
+        np.ndarray: syndromes with shape (trial, lattice (X, Z), layer, position)
+    """
+    if fname.endswith(".bin"):
+        header, packed = open_trajectory(fname)
+        data = np.unpackbits(packed, axis=-1, count=int(header["num_node_layer"]), bitorder="little")
+        return data.view(np.int8)
+
+    # text trajectory is parsed once and cached as pickle
+    pklname = fname.replace(".txt", ".pkl")
+    try:
+        with open(pklname, "rb") as fin:
+            return pickle.load(fin)
+    except:
+        val = np.loadtxt(fname, dtype=np.int8)
+        data = val.reshape([num_sample, 2, -1, num_synd])
+        with open(pklname, "wb") as fout:
+            pickle.dump(data, fout)
+        return data
+
+
+def list_trajectory(folder_name: str) -> list:
+    """List trajectory files in the folder, binary files first
+
+    Args:
+        folder_name (str): folder name
+
+    Returns:
+        list: list of file names
+    """
+    flist = glob.glob(f"./{folder_name}/*.bin")
+    binary_stems = set(fname[:-len(".bin")] for fname in flist)
+    flist += [fname for fname in glob.glob(f"./{folder_name}/*.txt") if fname[:-len(".txt")] not in binary_stems]
+    return flist
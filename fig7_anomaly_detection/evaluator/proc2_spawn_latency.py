@@ -33,7 +33,7 @@ for anomaly_ratio in [1, 10, 20, 30, 40, 50, 60, 70, 80, 90, 100]:
         sample = 100
         anomaly_pos = 5
         cycle = int(cycle)
-        arg = ["../../generator/bin/surface_code_3d_anomaly_long", f"result_ratio{anomaly_ratio}_cycle{cycle}.txt", 
+        arg = ["../../generator/bin/surface_code_3d_anomaly_long", f"result_ratio{anomaly_ratio}_cycle{cycle}.bin", 
         f"{distance}", f"{cycle}", f"{sample}", f"{physical_error_rate}", str(anomaly_ratio), f"{anomaly_size}", f"{anomaly_pos}"]
         task_list.append(arg)
 task_list = task_list * repeat
@@ -7,6 +7,8 @@ import glob
 import numpy as np
 import pickle
 
+from _util_trajectory import list_trajectory, load_trajectory
+
 trajectory_folder = "data_trajectory"
 
 def recalc_above(nth):
@@ -16,7 +18,7 @@ def recalc_above(nth):
             ratio, size, threshold = line.split(" ")
             required_window[int(ratio)] = (int(size), float(threshold))
 
-    flist = glob.glob(f"./{trajectory_folder}/*.txt")
+    flist = list_trajectory(trajectory_folder)
     num_sample = 100
     d = 21
     num_synd = d*(d-1)
@@ -25,17 +27,7 @@ def recalc_above(nth):
     result_dict = {}
 
     for fname in flist:
-        pklname = fname.replace(".txt", ".pkl")
-        try:
-            fin = open(pklname, "rb")
-            data = pickle.load(fin)
-            fin.close()
-        except:
-            val = np.loadtxt(fname, dtype=np.int8)
-            data = val.reshape([num_sample, 2, -1, num_synd])
-            fout = open(pklname, "wb")
-            pickle.dump(data, fout)
-            fout.close()
+        data = load_trajectory(fname, num_sample, num_synd)
 
         print(fname)
         ratio = int(fname.split(".")[-2].split("_")[-2].replace("ratio", ""))
@@ -6,10 +6,12 @@ import glob
 import numpy as np
 import pickle
 
+from _util_trajectory import list_trajectory, load_trajectory
+
 trajectory_folder = "data_trajectory"
 
 def recalc_position():
-    fposlist = glob.glob(f"./{trajectory_folder}/*.txt.pos")
+    fposlist = glob.glob(f"./{trajectory_folder}/*.pos")
     fposfile = fposlist[0]
     try:
         fin = open("./result/_pospick.pkl", "rb")
@@ -38,17 +40,14 @@ def recalc_position():
         for line in fin:
             ratio, size, threshold = line.split(" ")
             required_window[int(ratio)] = (int(size), float(threshold))
-    flist = glob.glob(f"./{trajectory_folder}/*.txt")
+    flist = list_trajectory(trajectory_folder)
     num_sample = 100
     d = 21
     num_synd = d*(d-1)
     ratios = [10, 20, 30, 40, 50, 60, 70, 80, 90, 100]
     result_dict = {}
     for fname in flist:
-        pklname = fname.replace(".txt", ".pkl")
-        fin = open(pklname, "rb")
-        data = pickle.load(fin)
-        fin.close()
+        data = load_trajectory(fname, num_sample, num_synd)
 
         ratio = int(fname.split(".")[-2].split("_")[-2].replace("ratio", ""))
         if ratio == 1:
@@ -0,0 +1,190 @@
+// Copyright 2022 NTT CORPORATION
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+/*
+Online anomaly detector with sliding windows.
+
+For each stabilizer, the number of active syndromes in the latest window_size layers is kept with a ring buffer.
+Without anomaly, the syndrome of a stabilizer at a layer is the parity of the space edges of the layer and the time edges to the previous and next layers,
+so syndromes of consecutive layers are correlated through the time edges, and the count in a window is over-dispersed compared with a binomial distribution.
+The exact distribution of the count is calculated with a Markov chain over the time edges,
+and a stabilizer is "above" when its count exceeds the smallest threshold t with P(count > t) <= 1 - confidence.
+The detector fires when the number of stabilizers above thresholds exceeds min_above_count.
+Assuming that stabilizers are independent, the distribution of the number of stabilizers above thresholds without anomaly is also calculated,
+which gives the false-alarm probability of a window and its union bound over the windows of a sliding scan.
+*/
+
+// flip probabilities of the syndrome of a stabilizer without anomaly, see SyndromeLattice::layer_flip_probability
+struct StabilizerNoise {
+	double space_prob;
+	double time_prob;
+};
+
+class SlidingWindowDetector {
+private:
+	uint32_t _window_size;
+	uint32_t _num_stabilizer;
+	uint32_t _min_above_count;
+	std::vector<uint32_t> _threshold;
+	// _above_distribution[n] is the probability that n stabilizers are above thresholds in a window without anomaly
+	std::vector<double> _above_distribution;
+	// _ring[(layer % window_size) * num_stabilizer + i] is the syndrome of stabilizer i at layer
+	std::vector<uint8_t> _ring;
+	std::vector<uint32_t> _count;
+	uint32_t _num_layer;
+	uint32_t _above_count;
+
+public:
+	// distribution of the number of active syndromes of a stabilizer in window_size consecutive layers in the bulk
+	static std::vector<double> window_count_distribution(uint32_t window_size, const StabilizerNoise& noise) {
+		const double q = noise.time_prob;
+		const double a = noise.space_prob;
+		// dist[t][c]: the time edge to the next layer is flipped (t) and c syndromes are active so far
+		std::vector<double> dist[2], next_dist[2];
+		for (int t = 0; t < 2; ++t) {
+			dist[t].assign(window_size + 1, 0.);
+			next_dist[t].assign(window_size + 1, 0.);
+		}
+		dist[0][0] = 1. - q;
+		dist[1][0] = q;
+		for (uint32_t layer = 0; layer < window_size; ++layer) {
+			for (int t = 0; t < 2; ++t) std::fill(next_dist[t].begin(), next_dist[t].end(), 0.);
+			for (int t_in = 0; t_in < 2; ++t_in) {
+				for (int t_out = 0; t_out < 2; ++t_out) {
+					double p_out = t_out ? q : 1. - q;
+					// the syndrome is the parity of the incoming and outgoing time edges and the space edges
+					double p_active = (t_in ^ t_out) ? 1. - a : a;
+					for (uint32_t c = 0; c <= layer; ++c) {
+						double w = dist[t_in][c] * p_out;
+						next_dist[t_out][c] += w * (1. - p_active);
+						next_dist[t_out][c + 1] += w * p_active;
+					}
+				}
+			}
+			std::swap(dist[0], next_dist[0]);
+			std::swap(dist[1], next_dist[1]);
+		}
+		std::vector<double> result(window_size + 1);
+		for (uint32_t c = 0; c <= window_size; ++c) result[c] = dist[0][c] + dist[1][c];
+		return result;
+	}
+
+	// the smallest threshold t with P(count > t) <= 1 - confidence, and P(count > t)
+	static std::pair<uint32_t, double> count_threshold(const std::vector<double>& distribution, double confidence) {
+		uint32_t threshold = (uint32_t)distribution.size() - 1;
+		double tail = 0.;
+		while (threshold > 0 && tail + distribution[threshold] <= 1. - confidence) {
+			tail += distribution[threshold];
+			threshold--;
+		}
+		return std::make_pair(threshold, tail);
+	}
+
+	// noise[i] is the flip probabilities of stabilizer i without anomaly
+	SlidingWindowDetector(uint32_t window_size, const std::vector<StabilizerNoise>& noise, double confidence, uint32_t min_above_count)
+		: _window_size(window_size), _num_stabilizer((uint32_t)noise.size()), _min_above_count(min_above_count) {
+		assert(window_size > 0);
+		// most stabilizers share the same noise, so thresholds are cached
+		std::map<std::pair<double, double>, std::pair<uint32_t, double>> cache;
+		std::vector<double> above_prob(_num_stabilizer);
+		_threshold.resize(_num_stabilizer);
+		for (uint32_t i = 0; i < _num_stabilizer; ++i) {
+			auto key = std::make_pair(noise[i].space_prob, noise[i].time_prob);
+			auto it = cache.find(key);
+			if (it == cache.end()) it = cache.emplace(key, count_threshold(window_count_distribution(window_size, noise[i]), confidence)).first;
+			_threshold[i] = it->second.first;
+			above_prob[i] = it->second.second;
+		}
+		// Poisson-binomial distribution of the number of stabilizers above thresholds
+		_above_distribution.assign(_num_stabilizer + 1, 0.);
+		_above_distribution[0] = 1.;
+		for (uint32_t i = 0; i < _num_stabilizer; ++i) {
+			for (uint32_t n = i + 1; n > 0; --n) {
+				_above_distribution[n] = _above_distribution[n] * (1. - above_prob[i]) + _above_distribution[n - 1] * above_prob[i];
+			}
+			_above_distribution[0] *= 1. - above_prob[i];
+		}
+		_ring.resize((size_t)_window_size * _num_stabilizer);
+		_count.resize(_num_stabilizer);
+		reset();
+	}
+	virtual ~SlidingWindowDetector() {}
+
+	void reset() {
+		std::fill(_ring.begin(), _ring.end(), 0);
+		std::fill(_count.begin(), _count.end(), 0);
+		_num_layer = 0;
+		_above_count = 0;
+	}
+
+	// push syndromes of the next layer and return true if the detector fires
+	bool push_layer(const uint8_t* syndrome) {
+		uint8_t* slot = _ring.data() + (size_t)(_num_layer % _window_size) * _num_stabilizer;
+		int32_t diff = 0;
+		for (uint32_t i = 0; i < _num_stabilizer; ++i) {
+			uint32_t before = _count[i];
+			uint32_t after = before - slot[i] + syndrome[i];
+			slot[i] = syndrome[i];
+			_count[i] = after;
+			diff += (int32_t)(after > _threshold[i]) - (int32_t)(before > _threshold[i]);
+		}
+		_above_count += diff;
+		_num_layer++;
+		return is_fired();
+	}
+
+	// the window is filled and enough stabilizers are above thresholds
+	bool is_fired() const {
+		return _num_layer >= _window_size && _above_count > _min_above_count;
+	}
+	bool is_above(uint32_t index) const {
+		return _count[index] > _threshold[index];
+	}
+	uint32_t get_num_layer() const {
+		return _num_layer;
+	}
+	uint32_t get_above_count() const {
+		return _above_count;
+	}
+	uint32_t get_window_size() const {
+		return _window_size;
+	}
+	uint32_t get_num_stabilizer() const {
+		return _num_stabilizer;
+	}
+	uint32_t get_threshold(uint32_t index) const {
+		return _threshold[index];
+	}
+
+	// probability that a window without anomaly fires with min_above_count
+	double window_false_alarm(uint32_t min_above_count) const {
+		double prob = 0.;
+		for (uint32_t n = min_above_count + 1; n <= _num_stabilizer; ++n) prob += _above_distribution[n];
+		return prob;
+	}
+	double window_false_alarm() const {
+		return window_false_alarm(_min_above_count);
+	}
+	// union bound of the probability that a scan over num_layer layers without anomaly fires at least once
+	double scan_false_alarm_bound(uint32_t num_layer, uint32_t min_above_count) const {
+		if (num_layer < _window_size) return 0.;
+		return std::min(1., (num_layer - _window_size + 1) * window_false_alarm(min_above_count));
+	}
+	double scan_false_alarm_bound(uint32_t num_layer) const {
+		return scan_false_alarm_bound(num_layer, _min_above_count);
+	}
+	// the smallest min_above_count whose scan_false_alarm_bound is at most target
+	uint32_t required_min_above_count(uint32_t num_layer, double target) const {
+		uint32_t min_above_count = 0;
+		while (min_above_count < _num_stabilizer && scan_false_alarm_bound(num_layer, min_above_count) > target) min_above_count++;
+		return min_above_count;
+	}
+};
@@ -2,44 +2,88 @@
 
 #pragma once
 
+#include <chrono>
 #include <vector>
 #include "syndrome_lattice_base.hpp"
 #include "blossom5/PerfectMatching.h"
 
 using MatchingResult = std::vector<std::pair<NodeIndex, NodeIndex>>;
 
+// accumulated cost of decode() calls
+struct DecoderTiming {
+	uint64_t call_count = 0;
+	uint64_t node_count = 0;
+	uint64_t edge_count = 0;
+	// seconds for fetching weights, building matching graphs, and solving matchings
+	double weight_time = 0.;
+	double build_time = 0.;
+	double solve_time = 0.;
+};
+
 class Decoder {
 private:
+	using Clock = std::chrono::steady_clock;
+
+	// weights from a detected node to the following ones, reused across calls and grown to the largest size so far
+	std::vector<WeightType> _weight_row;
+	DecoderTiming _timing;
+
+	static double _elapsed(Clock::time_point& start) {
+		Clock::time_point now = Clock::now();
+		double seconds = std::chrono::duration<double>(now - start).count();
+		start = now;
+		return seconds;
+	}
 public:
 	Decoder() {};
 	virtual ~Decoder() {};
 	virtual MatchingResult decode(const SyndromeSample& detected_nodes, const SyndromeLattice& syndrome_lattice) {
-		// create graph
+		MatchingResult matching;
 		NodeIndex node_cnt = (NodeIndex)detected_nodes.size();
-		EdgeIndex edge_cnt = node_cnt * (node_cnt - 1);
-		PerfectMatching* pm = new PerfectMatching((signed)node_cnt, (signed)edge_cnt);
-		for (NodeIndex i = 0; i < node_cnt; ++i) {
+		_timing.call_count++;
+		if (node_cnt == 0) return matching;
+
+		// create graph with the edges of the complete graph
+		Clock::time_point start = Clock::now();
+		double weight_time = 0.;
+		EdgeIndex edge_cnt = node_cnt * (node_cnt - 1) / 2;
+		if (_weight_row.size() < node_cnt) _weight_row.resize(node_cnt);
+		PerfectMatching pm((signed)node_cnt, (signed)edge_cnt);
+		for (NodeIndex i = 0; i + 1 < node_cnt; ++i) {
+			Clock::time_point weight_start = Clock::now();
+			syndrome_lattice.get_weight_row(detected_nodes[i], detected_nodes.data() + i + 1, node_cnt - i - 1, _weight_row.data());
+			weight_time += _elapsed(weight_start);
 			for (NodeIndex j = i + 1; j < node_cnt; ++j) {
-				WeightType weight = syndrome_lattice.get_weight(detected_nodes[i], detected_nodes[j]);
+				WeightType weight = _weight_row[j - i - 1];
 #ifdef PERFECT_MATCHING_DOUBLE
-				pm->AddEdge(i, j, (PerfectMatching::REAL)weight);
+				pm.AddEdge(i, j, (PerfectMatching::REAL)weight);
 #else
 				// NOTE: if MWPM is int precision, add delta for avoiding rounded to small value
-				pm->AddEdge(i, j, (PerfectMatching::REAL)(weight+1e-10));
+				pm.AddEdge(i, j, (PerfectMatching::REAL)(weight+1e-10));
 #endif
 			}
 		}
-		pm->options.verbose = false;
-		pm->Solve();
+		_timing.weight_time += weight_time;
+		_timing.build_time += _elapsed(start) - weight_time;
+
+		pm.options.verbose = false;
+		pm.Solve();
 
-		MatchingResult matching;
 		for (NodeIndex i = 0; i < node_cnt; i++) {
-			NodeIndex j = pm->GetMatch(i);
+			NodeIndex j = pm.GetMatch(i);
 			if (j <= i) continue;
 			matching.push_back(std::make_pair(detected_nodes[i], detected_nodes[j]));
 		}
-		delete pm;
+		_timing.solve_time += _elapsed(start);
+		_timing.node_count += node_cnt;
+		_timing.edge_count += edge_cnt;
 		return matching;
 	}
-};
 
+	const DecoderTiming& get_timing() const {
+		return _timing;
+	}
+	void reset_timing() {
+		_timing = DecoderTiming();
+	}
+};
@@ -3,6 +3,12 @@
 #pragma once
 
 #include <cassert>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
 #include <vector>
 #include <algorithm>
 #include <numeric>
@@ -25,6 +31,152 @@ private:
 	std::vector<WeightType> _error_prob_X_list;
 	std::vector<WeightType> _error_prob_Y_list;
 	std::vector<WeightType> _error_prob_Z_list;
+	// upper bound of px+py+pz over all edges, used as a proposal rate of geometric-skip sampling
+	WeightType _max_error_prob = 0.;
+
+	// position of each edge and the bits of check_parity flipped by its error, precomputed in constructor
+	struct EdgeCoordinate {
+		int16_t x;
+		int16_t y;
+		int32_t z;
+	};
+	std::vector<EdgeCoordinate> _edge_coordinate;
+	std::vector<uint8_t> _edge_parity_mask;
+
+	// anomalous edges of static anomaly models, cached per model parameters
+	struct AnomalyMask {
+		std::vector<uint8_t> anomaly_edge;
+		std::vector<EdgeIndex> anomaly_edge_list;
+	};
+	mutable std::map<std::tuple<int, int, int>, std::shared_ptr<const AnomalyMask>> _anomaly_mask_cache;
+	mutable std::mutex _anomaly_mask_mutex;
+
+	template <class Predicate>
+	std::shared_ptr<const AnomalyMask> _create_anomaly_mask(Predicate is_anomaly) const {
+		std::shared_ptr<AnomalyMask> mask(new AnomalyMask);
+		mask->anomaly_edge.assign(_num_edge, 0);
+		for (EdgeIndex i = 0; i < _num_edge; ++i) {
+			if (is_anomaly(_edge_coordinate[i])) {
+				mask->anomaly_edge[i] = 1;
+				mask->anomaly_edge_list.push_back(i);
+			}
+		}
+		return mask;
+	}
+	template <class Predicate>
+	std::shared_ptr<const AnomalyMask> _get_anomaly_mask(int model, int anomaly_size, int anomaly_pos, Predicate is_anomaly) const {
+		auto key = std::make_tuple(model, anomaly_size, anomaly_pos);
+		std::lock_guard<std::mutex> lock(_anomaly_mask_mutex);
+		auto it = _anomaly_mask_cache.find(key);
+		if (it != _anomaly_mask_cache.end()) return it->second;
+		auto mask = _create_anomaly_mask(is_anomaly);
+		_anomaly_mask_cache[key] = mask;
+		return mask;
+	}
+
+	// anomaly models of _generate_sample_kernel
+	//  start_cycle(random) is called at the beginning of every cycle, and is_anomaly(i) tells whether edge i is anomalous
+	struct StaticAnomaly {
+		const std::vector<uint8_t>& anomaly_edge;
+		void start_cycle(Random&) {}
+		bool is_anomaly(EdgeIndex i) const { return anomaly_edge[i] != 0; }
+	};
+	// every qubit becomes anomalous with anomaly_prob at the beginning of each cycle, and stays anomalous
+	struct AccumulatingAnomaly {
+		const std::vector<EdgeCoordinate>& edge_coordinate;
+		uint32_t lattice_width;
+		double anomaly_prob;
+		std::vector<uint8_t> anomaly;
+		void start_cycle(Random& random) {
+			for (auto& flag : anomaly) {
+				if (random.sample_double() < anomaly_prob) flag = 1;
+			}
+		}
+		bool is_anomaly(EdgeIndex i) const {
+			return anomaly[edge_coordinate[i].x + edge_coordinate[i].y * lattice_width] != 0;
+		}
+	};
+
+	// sample errors of all the edges with a random number per edge
+	// the error probabilities of anomalous edges are multiplied by anomaly_ratio
+	template <class AnomalyModel>
+	std::pair<ErrorSample, uint8_t> _generate_sample_kernel(Random& random, AnomalyModel& model, double anomaly_ratio) const {
+		assert(_error_prob_X_list.size() == _num_edge);
+		assert(_error_prob_Y_list.size() == _num_edge);
+		assert(_error_prob_Z_list.size() == _num_edge);
+		ErrorSample vec(_num_edge, 0);
+		uint8_t check_parity = 0;
+		for (EdgeIndex begin = 0; begin < _num_edge; begin += _num_edge_cycle) {
+			model.start_cycle(random);
+			EdgeIndex end = std::min(_num_edge, begin + _num_edge_cycle);
+			for (EdgeIndex i = begin; i < end; ++i) {
+				double r = random.sample_double();
+				double px = _error_prob_X_list[i];
+				double py = _error_prob_Y_list[i];
+				double pz = _error_prob_Z_list[i];
+				if (model.is_anomaly(i)) {
+					px *= anomaly_ratio;
+					py *= anomaly_ratio;
+					pz *= anomaly_ratio;
+				}
+				_apply_error(vec, check_parity, i, r, px, py, pz);
+			}
+		}
+		return make_pair(vec, check_parity);
+	}
+
+	void _update_max_error_prob(EdgeIndex edge_index) {
+		_max_error_prob = std::max(_max_error_prob, _error_prob_X_list[edge_index] + _error_prob_Y_list[edge_index] + _error_prob_Z_list[edge_index]);
+	}
+
+	// flip error bits of edge i according to r and append the crossing of logical operators to check_parity
+	//  X or Y error (r < px + py) flips bit 0, and Y or Z error (px <= r < px + py + pz) flips bit 1
+	void _apply_error(ErrorSample& vec, uint8_t& check_parity, EdgeIndex i, double r, double px, double py, double pz) const {
+		uint8_t error = (uint8_t)(r < px + py) | (uint8_t)((px <= r && r < px + py + pz) << 1);
+		vec[i] ^= error;
+		check_parity ^= error & _edge_parity_mask[i];
+	}
+
+	// number of failures before the first success of Bernoulli trials with log(1-rate) = log_q
+	static uint64_t _sample_geometric_gap(Random& random, double log_q) {
+		double gap = std::floor(std::log(1.0 - random.sample_double()) / log_q);
+		if (gap >= (double)(std::numeric_limits<uint32_t>::max())) return std::numeric_limits<uint32_t>::max();
+		return (uint64_t)gap;
+	}
+
+	// Geometric-skip sampling with thinning.
+	// Candidate edges are visited with a uniform proposal rate (the maximum error probability),
+	// and a candidate becomes an error with probability p_i / rate, which reproduces the per-edge Bernoulli statistics.
+	// Normal edges and anomalous edges are visited in separate passes since their rates differ by anomaly_ratio.
+	std::pair<ErrorSample, uint8_t> _generate_sample_geometric(Random& random, const std::vector<uint8_t>& anomaly_edge, const std::vector<EdgeIndex>& anomaly_edge_list, double anomaly_ratio) const {
+		ErrorSample vec(_num_edge, 0);
+		uint8_t check_parity = 0;
+
+		// normal edges: candidates on anomalous edges are discarded
+		double rate = std::min(1.0, (double)_max_error_prob);
+		if (rate > 0.) {
+			double log_q = std::log1p(-rate);
+			for (uint64_t i = (rate < 1.) ? _sample_geometric_gap(random, log_q) : 0; i < _num_edge;
+				i += 1 + ((rate < 1.) ? _sample_geometric_gap(random, log_q) : 0)) {
+				if (anomaly_edge[i]) continue;
+				double r = random.sample_double() * rate;
+				_apply_error(vec, check_parity, (EdgeIndex)i, r, get_error_prob_X((EdgeIndex)i), get_error_prob_Y((EdgeIndex)i), get_error_prob_Z((EdgeIndex)i));
+			}
+		}
+
+		// anomalous edges
+		double rate_anomaly = std::min(1.0, _max_error_prob * anomaly_ratio);
+		if (rate_anomaly > 0.) {
+			double log_q = std::log1p(-rate_anomaly);
+			for (uint64_t k = (rate_anomaly < 1.) ? _sample_geometric_gap(random, log_q) : 0; k < anomaly_edge_list.size();
+				k += 1 + ((rate_anomaly < 1.) ? _sample_geometric_gap(random, log_q) : 0)) {
+				EdgeIndex i = anomaly_edge_list[k];
+				double r = random.sample_double() * rate_anomaly;
+				_apply_error(vec, check_parity, i, r, get_error_prob_X(i) * anomaly_ratio, get_error_prob_Y(i) * anomaly_ratio, get_error_prob_Z(i) * anomaly_ratio);
+			}
+		}
+		return make_pair(vec, check_parity);
+	}
 public:
 	const uint32_t _distance;
 	const uint32_t _cycle;
@@ -42,6 +194,15 @@ public:
 		_error_prob_X_list = std::vector<WeightType>(_num_edge, 0.);
 		_error_prob_Y_list = std::vector<WeightType>(_num_edge, 0.);
 		_error_prob_Z_list = std::vector<WeightType>(_num_edge, 0.);
+
+		_edge_coordinate.resize(_num_edge);
+		_edge_parity_mask.resize(_num_edge);
+		for (EdgeIndex i = 0; i < _num_edge; ++i) {
+			Position pos = index_to_position(i);
+			_edge_coordinate[i] = { (int16_t)pos.x, (int16_t)pos.y, (int32_t)pos.z };
+			// errors on data edges crossing x=0 or y=0 flip logical operators
+			_edge_parity_mask[i] = (uint8_t)((pos.x == 0 && pos.z % 2 == 0) | ((pos.y == 0 && pos.z % 2 == 0) << 1));
+		}
 	}
 
 	bool _is_exist_core(const Position& pos) const {
@@ -157,12 +318,18 @@ public:
 	}
 	void stack_error_prob_X(EdgeIndex edge_index, double value) {
 		_error_prob_X_list[edge_index] += value;
+		_update_max_error_prob(edge_index);
 	}
 	void stack_error_prob_Y(EdgeIndex edge_index, double value) {
 		_error_prob_Y_list[edge_index] += value;
+		_update_max_error_prob(edge_index);
 	}
 	void stack_error_prob_Z(EdgeIndex edge_index, double value) {
 		_error_prob_Z_list[edge_index] += value;
+		_update_max_error_prob(edge_index);
+	}
+	EdgeIndex get_num_edge() const {
+		return _num_edge;
 	}
 	WeightType get_error_prob_X(EdgeIndex edge_index) const {
 		return _error_prob_X_list[edge_index];
@@ -175,227 +342,71 @@ public:
 	}
 
 	std::pair<ErrorSample, uint8_t> generate_sample(Random& random, double anomaly_prob, double anomaly_ratio) const {
-		ErrorSample vec(_num_edge, 0);
-        uint32_t lattice_width = _distance * 2 - 1;
-        uint32_t qubit_count = lattice_width * lattice_width;
-
-        std::vector<uint8_t> anomaly(qubit_count, 0);
-
-        uint8_t check_parity = 0;
-		assert(_error_prob_X_list.size() == _num_edge);
-		assert(_error_prob_Y_list.size() == _num_edge);
-		assert(_error_prob_Z_list.size() == _num_edge);
-        
-        uint32_t update_cycle = _num_edge_data_layer + _num_edge_meas_layer;
+		uint32_t lattice_width = _distance * 2 - 1;
+		AccumulatingAnomaly model = { _edge_coordinate, lattice_width, anomaly_prob, std::vector<uint8_t>(lattice_width * lattice_width, 0) };
+		return _generate_sample_kernel(random, model, anomaly_ratio);
+	}
 
-		for (EdgeIndex i = 0; i < _num_edge; ++i) {
 
-            if (i%update_cycle == 0) {
-                for (uint32_t qubit_index = 0; qubit_index < qubit_count; ++qubit_index) {
-                    double r = random.sample_double();
-                    if (r < anomaly_prob) {
-                        anomaly[qubit_index] = 1;
-                    }
-                }
-            }
+	std::pair<ErrorSample, uint8_t> generate_sample_constant_anomaly(Random& random, double anomaly_prob, double anomaly_ratio, bool geometric = false) const {
+		uint32_t lattice_width = _distance * 2 - 1;
+		uint32_t qubit_count = lattice_width * lattice_width;
 
-            Position pos = index_to_position(i);
-            uint32_t qubit_index = pos.x + pos.y*lattice_width;
-            uint8_t is_anomaly = anomaly[qubit_index];
+		std::vector<uint8_t> anomaly(qubit_count, 0);
 
-            double r = random.sample_double();
-            double px = get_error_prob_X(i);
-            double py = get_error_prob_Y(i);
-            double pz = get_error_prob_Z(i);
-            if (is_anomaly) {
-                px *= anomaly_ratio;
-                py *= anomaly_ratio;
-                pz *= anomaly_ratio;
-            }
+		std::vector<uint32_t> anomaly_check(qubit_count, 0);
+		std::iota(anomaly_check.begin(), anomaly_check.end(), 0);
+		std::shuffle(anomaly_check.begin(), anomaly_check.end(), random);
+		for (uint32_t ind = 0; ind < (uint32_t)(qubit_count*anomaly_prob); ++ind) {
+			uint32_t qubit_index = anomaly_check[ind];
+			anomaly[qubit_index] = 1;
+		}
 
-			if (r < px + py) {
-				vec[i] ^= 1;
-				if (pos.x == 0 && pos.z%2==0) {
-					check_parity ^= 1;
-				}
-			}
-			if (px <= r && r < px + py + pz) {
-				vec[i] ^= 2;
-				if (pos.y == 0 && pos.z%2==0) {
-					check_parity ^= 2;
-				}
-			}
+		// anomalous qubits differ in every call, so the mask is not cached
+		auto mask = _create_anomaly_mask([&](const EdgeCoordinate& c) { return anomaly[c.x + c.y * lattice_width] != 0; });
+		if (geometric) {
+			return _generate_sample_geometric(random, mask->anomaly_edge, mask->anomaly_edge_list, anomaly_ratio);
 		}
-		return make_pair(vec, check_parity);
+		StaticAnomaly model = { mask->anomaly_edge };
+		return _generate_sample_kernel(random, model, anomaly_ratio);
 	}
 
 
-    std::pair<ErrorSample, uint8_t> generate_sample_constant_anomaly(Random& random, double anomaly_prob, double anomaly_ratio) const {
-        ErrorSample vec(_num_edge, 0);
-        uint32_t lattice_width = _distance * 2 - 1;
-        uint32_t qubit_count = lattice_width * lattice_width;
-
-        std::vector<uint8_t> anomaly(qubit_count, 0);
-
-        std::vector<uint32_t> anomaly_check(qubit_count, 0);
-        std::iota(anomaly_check.begin(), anomaly_check.end(), 0);
-        std::random_device rd;
-        std::mt19937 engine(rd());
-        std::shuffle(anomaly_check.begin(), anomaly_check.end(), engine);
-        for (uint32_t ind = 0; ind < (uint32_t)(qubit_count*anomaly_prob); ++ind) {
-            uint32_t qubit_index = anomaly_check[ind];
-            anomaly[qubit_index] = 1;
-        }
-
-        uint8_t check_parity = 0;
-        assert(_error_prob_X_list.size() == _num_edge);
-        assert(_error_prob_Y_list.size() == _num_edge);
-        assert(_error_prob_Z_list.size() == _num_edge);
-
-        for (EdgeIndex i = 0; i < _num_edge; ++i) {
-
-            Position pos = index_to_position(i);
-            uint32_t qubit_index = pos.x + pos.y*lattice_width;
-            uint8_t is_anomaly = anomaly[qubit_index];
-
-            double r = random.sample_double();
-            double px = get_error_prob_X(i);
-            double py = get_error_prob_Y(i);
-            double pz = get_error_prob_Z(i);
-            if (is_anomaly) {
-                px *= anomaly_ratio;
-                py *= anomaly_ratio;
-                pz *= anomaly_ratio;
-            }
-
-            if (r < px + py) {
-                vec[i] ^= 1;
-                if (pos.x == 0 && pos.z % 2 == 0) {
-                    check_parity ^= 1;
-                }
-            }
-            if (px <= r && r < px + py + pz) {
-                vec[i] ^= 2;
-                if (pos.y == 0 && pos.z % 2 == 0) {
-                    check_parity ^= 2;
-                }
-            }
-        }
-        return make_pair(vec, check_parity);
-    }
-
-
-    std::pair<ErrorSample, uint8_t> generate_sample_anomaly_region(Random& random, double anomaly_ratio, int anomaly_size, int anomaly_pos) const {
-        ErrorSample vec(_num_edge, 0);
-        uint32_t lattice_width = _distance * 2 - 1;
-        uint32_t qubit_count = lattice_width * lattice_width;
-
-        std::vector<uint8_t> anomaly_edge(_num_edge, 0);
-
-        int32_t center = lattice_width / 2 + anomaly_pos;
-        for (uint32_t ind = 0; ind < _num_edge; ++ind) {
-            Position pos = index_to_position(ind);
-            if(std::abs(pos.x-center) < anomaly_size && std::abs(pos.y-center) < anomaly_size)
-                anomaly_edge[ind] = 1;
-        }
-
-        uint8_t check_parity = 0;
-        assert(_error_prob_X_list.size() == _num_edge);
-        assert(_error_prob_Y_list.size() == _num_edge);
-        assert(_error_prob_Z_list.size() == _num_edge);
-
-        for (EdgeIndex i = 0; i < _num_edge; ++i) {
-
-            Position pos = index_to_position(i);
-            uint8_t is_anomaly = anomaly_edge[i];
-
-            double r = random.sample_double();
-            double px = get_error_prob_X(i);
-            double py = get_error_prob_Y(i);
-            double pz = get_error_prob_Z(i);
-            if (is_anomaly) {
-                px *= anomaly_ratio;
-                py *= anomaly_ratio;
-                pz *= anomaly_ratio;
-            }
-
-            if (r < px + py) {
-                vec[i] ^= 1;
-                if (pos.x == 0 && pos.z % 2 == 0) {
-                    check_parity ^= 1;
-                }
-            }
-            if (px <= r && r < px + py + pz) {
-                vec[i] ^= 2;
-                if (pos.y == 0 && pos.z % 2 == 0) {
-                    check_parity ^= 2;
-                }
-            }
-        }
-        return make_pair(vec, check_parity);
-    }
-
-
-    bool is_anomaly_pos(Position pos, int anomaly_size, int anomaly_pos) const {
-        uint32_t lattice_width = _distance * 2 - 1;
-        int32_t center = lattice_width / 2 + anomaly_pos;
-        return (
-            std::abs(pos.x - center) < anomaly_size 
-            && std::abs(pos.y - center) < anomaly_size
-            && _cycle / 2 <= pos.z 
-            && pos.z < _cycle * 3 / 2
-            );
-    }
-
-    std::pair<ErrorSample, uint8_t> generate_sample_anomaly_region_long(Random& random, double anomaly_ratio, int anomaly_size, int anomaly_pos) const {
-        ErrorSample vec(_num_edge, 0);
-        uint32_t lattice_width = _distance * 2 - 1;
-        uint32_t qubit_count = lattice_width * lattice_width;
-
-        std::vector<uint8_t> anomaly_edge(_num_edge, 0);
-
-        for (uint32_t ind = 0; ind < _num_edge; ++ind) {
-            Position pos = index_to_position(ind);
-            if(is_anomaly_pos(pos, anomaly_size, anomaly_pos))
-                anomaly_edge[ind] = 1;
-        }
-
-        uint8_t check_parity = 0;
-        assert(_error_prob_X_list.size() == _num_edge);
-        assert(_error_prob_Y_list.size() == _num_edge);
-        assert(_error_prob_Z_list.size() == _num_edge);
-
-        for (EdgeIndex i = 0; i < _num_edge; ++i) {
+	std::pair<ErrorSample, uint8_t> generate_sample_anomaly_region(Random& random, double anomaly_ratio, int anomaly_size, int anomaly_pos, bool geometric = false) const {
+		uint32_t lattice_width = _distance * 2 - 1;
+		int32_t center = lattice_width / 2 + anomaly_pos;
+		auto mask = _get_anomaly_mask(0, anomaly_size, anomaly_pos, [&](const EdgeCoordinate& c) {
+			return std::abs(c.x - center) < anomaly_size && std::abs(c.y - center) < anomaly_size;
+		});
+		if (geometric) {
+			return _generate_sample_geometric(random, mask->anomaly_edge, mask->anomaly_edge_list, anomaly_ratio);
+		}
+		StaticAnomaly model = { mask->anomaly_edge };
+		return _generate_sample_kernel(random, model, anomaly_ratio);
+	}
 
-            Position pos = index_to_position(i);
-            uint8_t is_anomaly = anomaly_edge[i];
 
-            double r = random.sample_double();
-            double px = get_error_prob_X(i);
-            double py = get_error_prob_Y(i);
-            double pz = get_error_prob_Z(i);
-            if (is_anomaly) {
-                //printf("%d %d %d / %d\n", pos.x, pos.y, pos.z, _cycle);
-                px *= anomaly_ratio;
-                py *= anomaly_ratio;
-                pz *= anomaly_ratio;
-            }
+	bool is_anomaly_pos(Position pos, int anomaly_size, int anomaly_pos) const {
+		uint32_t lattice_width = _distance * 2 - 1;
+		int32_t center = lattice_width / 2 + anomaly_pos;
+		return (
+			std::abs(pos.x - center) < anomaly_size
+			&& std::abs(pos.y - center) < anomaly_size
+			&& _cycle / 2 <= pos.z
+			&& pos.z < _cycle * 3 / 2
+			);
+	}
 
-            if (r < px + py) {
-                vec[i] ^= 1;
-                if (pos.x == 0 && pos.z % 2 == 0) {
-                    check_parity ^= 1;
-                }
-            }
-            if (px <= r && r < px + py + pz) {
-                vec[i] ^= 2;
-                if (pos.y == 0 && pos.z % 2 == 0) {
-                    check_parity ^= 2;
-                }
-            }
-        }
-        return make_pair(vec, check_parity);
-    }
+	std::pair<ErrorSample, uint8_t> generate_sample_anomaly_region_long(Random& random, double anomaly_ratio, int anomaly_size, int anomaly_pos, bool geometric = false) const {
+		auto mask = _get_anomaly_mask(1, anomaly_size, anomaly_pos, [&](const EdgeCoordinate& c) {
+			return is_anomaly_pos(Position(c.x, c.y, c.z), anomaly_size, anomaly_pos);
+		});
+		if (geometric) {
+			return _generate_sample_geometric(random, mask->anomaly_edge, mask->anomaly_edge_list, anomaly_ratio);
+		}
+		StaticAnomaly model = { mask->anomaly_edge };
+		return _generate_sample_kernel(random, model, anomaly_ratio);
+	}
 	void debug_print_lattice() const {
 		printf("////////////////\n");
 		for (unsigned int z = 0; z < 2 * _cycle; ++z) {
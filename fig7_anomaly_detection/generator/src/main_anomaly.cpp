@@ -19,9 +19,15 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <string>
 #include "error_lattice.hpp"
 #include "syndrome_lattice.hpp"
 #include "decoder.hpp"
+#include "trial_runner.hpp"
+#include "thread_option.hpp"
+
+SeedOption seed_option;
+ThreadOption thread_option;
 
 void set_error_lattice_uniform(double error_prob_x, double error_prob_y, double error_prob_z, ErrorLattice& error_lattice) {
 	for (unsigned int z = 0; z < 2 * error_lattice._cycle; ++z) {
@@ -39,13 +45,7 @@ void set_error_lattice_uniform(double error_prob_x, double error_prob_y, double
 }
 
 void calculate(std::string filename, int distance, int cycle, uint32_t trial_count, double error_prob, double error_prob_anomaly_happen, double error_prob_anomaly_ratio) {
-    Random random;
-#ifdef _DEBUG
-    unsigned int seed = 0;
-    random.set_seed(seed);
-#else
-    unsigned int seed = random.set_random_seed();
-#endif
+    uint64_t seed = seed_option.get();
 
     ErrorLattice error_lattice(distance, cycle);
     set_error_lattice_uniform(error_prob / 3, error_prob / 3, error_prob / 3, error_lattice);
@@ -65,20 +65,33 @@ void calculate(std::string filename, int distance, int cycle, uint32_t trial_cou
     printf("configure finish\n");
 
 
-    Decoder decoder;
-    unsigned int logical_x_count = 0;
-    unsigned int logical_y_count = 0;
-    unsigned int logical_z_count = 0;
-    for (unsigned int i = 0; i < trial_count; ++i) {
+    // lattices are shared by workers, and each worker has its own random stream, decoder and counters
+    struct Worker {
+        Random random;
+        Decoder decoder;
+        unsigned int logical_x_count = 0;
+        unsigned int logical_y_count = 0;
+        unsigned int logical_z_count = 0;
+#ifdef DEBUG_FLAG
+        unsigned int error_count_total = 0;
+        unsigned int error_position_total = 0;
+#endif
+    };
+    std::vector<Worker> workers(thread_option.get());
+    auto run_trial = [&](Worker& worker, uint32_t i, std::string&) {
+        Random& random = worker.random;
+        Decoder& decoder = worker.decoder;
+        // each trial uses its own substream
+        random.set_stream(seed, i);
         // create error and parity
         auto error_info = error_lattice.generate_sample(random, error_prob_anomaly_happen, error_prob_anomaly_ratio);
-        //auto error_info = error_lattice.generate_sample_constant_anomaly(random, error_prob_anomaly_happen, error_prob_anomaly_ratio);
+        //auto error_info = error_lattice.generate_sample_constant_anomaly(random, error_prob_anomaly_happen, error_prob_anomaly_ratio, true);
         ErrorSample error_sample = error_info.first;
         uint8_t correct_parity = error_info.second;
 
         // create syndrome
-        SyndromeSample detected_nodes_x = syndrome_lattice_x.create_symdrome(error_sample, error_lattice);
-        SyndromeSample detected_nodes_z = syndrome_lattice_z.create_symdrome(error_sample, error_lattice);
+        SyndromeSample detected_nodes_x, detected_nodes_z;
+        SyndromeLattice::create_symdrome_pair(error_sample, syndrome_lattice_x, syndrome_lattice_z, detected_nodes_x, detected_nodes_z);
 
         // decode
         MatchingResult matching_x = decoder.decode(detected_nodes_x, syndrome_lattice_x);
@@ -102,13 +115,13 @@ void calculate(std::string filename, int distance, int cycle, uint32_t trial_cou
             success = true;
         }
         else if (correct_parity == (answer_parity ^ 1)) {
-            logical_x_count++;
+            worker.logical_x_count++;
         }
         else if (correct_parity == (answer_parity ^ 2)) {
-            logical_z_count++;
+            worker.logical_z_count++;
         }
         else {
-            logical_y_count++;
+            worker.logical_y_count++;
         }
 
 #ifdef DEBUG_FLAG
@@ -118,8 +131,8 @@ void calculate(std::string filename, int distance, int cycle, uint32_t trial_cou
             if (val / 2) error_count++;
             if (val % 2) error_count++;
         }
-        error_count_total += error_count;
-        error_position_total += (unsigned int)error_sample.size();
+        worker.error_count_total += error_count;
+        worker.error_position_total += (unsigned int)error_sample.size();
 
         unsigned int matching_cost_x = 0;
         for (auto match : matching_x) {
@@ -171,10 +184,35 @@ void calculate(std::string filename, int distance, int cycle, uint32_t trial_cou
         }
 
 #endif
+    };
+    run_trials_parallel(workers, trial_count, run_trial, [](const std::string&) {});
+
+    unsigned int logical_x_count = 0;
+    unsigned int logical_y_count = 0;
+    unsigned int logical_z_count = 0;
+    DecoderTiming timing;
+    for (const auto& worker : workers) {
+        logical_x_count += worker.logical_x_count;
+        logical_y_count += worker.logical_y_count;
+        logical_z_count += worker.logical_z_count;
+#ifdef DEBUG_FLAG
+        error_count_total += worker.error_count_total;
+        error_position_total += worker.error_position_total;
+#endif
+        const DecoderTiming& worker_timing = worker.decoder.get_timing();
+        timing.call_count += worker_timing.call_count;
+        timing.node_count += worker_timing.node_count;
+        timing.edge_count += worker_timing.edge_count;
+        timing.weight_time += worker_timing.weight_time;
+        timing.build_time += worker_timing.build_time;
+        timing.solve_time += worker_timing.solve_time;
     }
+    printf("decode calls=%llu mean_nodes=%lf weight=%lfs build=%lfs solve=%lfs\n",
+        (unsigned long long)timing.call_count, 1. * timing.node_count / std::max((uint64_t)1, timing.call_count),
+        timing.weight_time, timing.build_time, timing.solve_time);
 
     FILE* fp = fopen(filename.c_str(), "a");
-    printf("distance=%d cycle=%d seed = %u\n", distance, cycle, seed);
+    printf("distance=%d cycle=%d seed = %llu\n", distance, cycle, (unsigned long long)seed);
     double logical_x_error_prob = 1.*logical_x_count / trial_count;
     double logical_y_error_prob = 1.*logical_y_count / trial_count;
     double logical_z_error_prob = 1.*logical_z_count / trial_count;
@@ -185,8 +223,8 @@ void calculate(std::string filename, int distance, int cycle, uint32_t trial_cou
 #ifdef DEBUG_FLAG
     printf("error count %d/%d (%lf)\n", error_count_total, error_position_total, 1.*error_count_total / error_position_total);
 #endif
-    fprintf(fp, "%d %d %u %lf %lf %lf %d %d %d %d\n",
-        distance, cycle, seed,
+    fprintf(fp, "%d %d %llu %lf %lf %lf %d %d %d %d\n",
+        distance, cycle, (unsigned long long)seed,
         error_prob, error_prob_anomaly_ratio, error_prob_anomaly_happen,
         trial_count, logical_x_count, logical_y_count, logical_z_count);
     fclose(fp);
@@ -195,13 +233,7 @@ void calculate(std::string filename, int distance, int cycle, uint32_t trial_cou
 
 
 void anomaly_detect(std::string filename, int distance, int cycle, uint32_t trial_count, double error_prob, double error_prob_anomaly_happen, double error_prob_anomaly_ratio) {
-    Random random;
-#ifdef _DEBUG
-    unsigned int seed = 0;
-    random.set_seed(seed);
-#else
-    unsigned int seed = random.set_random_seed();
-#endif
+    uint64_t seed = seed_option.get();
 
     ErrorLattice error_lattice(distance, cycle);
     set_error_lattice_uniform(error_prob / 3, error_prob / 3, error_prob / 3, error_lattice);
@@ -221,17 +253,26 @@ void anomaly_detect(std::string filename, int distance, int cycle, uint32_t tria
     printf("configure finish\n");
 
 
-    Decoder decoder;
+    // lattices are shared by workers, and outputs of trials are appended to the file in trial order
+    struct Worker {
+        Random random;
+        Decoder decoder;
+    };
+    std::vector<Worker> workers(thread_option.get());
     std::ofstream ofs(filename, std::ios::app);
-    for (unsigned int i = 0; i < trial_count; ++i) {
+    auto run_trial = [&](Worker& worker, uint32_t i, std::string& output) {
+        Random& random = worker.random;
+        Decoder& decoder = worker.decoder;
+        // each trial uses its own substream
+        random.set_stream(seed, i);
         // create error and parity
-        auto error_info = error_lattice.generate_sample_constant_anomaly(random, error_prob_anomaly_happen, error_prob_anomaly_ratio);
+        auto error_info = error_lattice.generate_sample_constant_anomaly(random, error_prob_anomaly_happen, error_prob_anomaly_ratio, true);
         ErrorSample error_sample = error_info.first;
         uint8_t correct_parity = error_info.second;
 
         // create syndrome
-        SyndromeSample detected_nodes_x = syndrome_lattice_x.create_symdrome(error_sample, error_lattice);
-        SyndromeSample detected_nodes_z = syndrome_lattice_z.create_symdrome(error_sample, error_lattice);
+        SyndromeSample detected_nodes_x, detected_nodes_z;
+        SyndromeLattice::create_symdrome_pair(error_sample, syndrome_lattice_x, syndrome_lattice_z, detected_nodes_x, detected_nodes_z);
 
         std::map<Position, int> counter_x, counter_z;
         for (auto value : detected_nodes_x) {
@@ -266,26 +307,21 @@ void anomaly_detect(std::string filename, int distance, int cycle, uint32_t tria
         uint8_t answer_parity = answer_parity_x + answer_parity_z * 2;
 
         uint32_t result_parity = answer_parity ^ correct_parity;
-        ofs << result_parity;
-        //ofs << " X"; for (auto pair : counter_x) ofs << " " << pair.first.x << " " << pair.first.y << " " << pair.second;
-        //ofs << " Z"; for (auto pair : counter_z) ofs << " " << pair.first.x << " " << pair.first.y << " " << pair.second;
-        ofs << " X"; for (auto pair : counter_x) ofs << " " << pair.second;
-        ofs << " Z"; for (auto pair : counter_z) ofs << " " << pair.second;
-        ofs << std::endl;
-
-    }
+        output += std::to_string(result_parity);
+        //output += " X"; for (auto pair : counter_x) output += " " + std::to_string(pair.first.x) + " " + std::to_string(pair.first.y) + " " + std::to_string(pair.second);
+        //output += " Z"; for (auto pair : counter_z) output += " " + std::to_string(pair.first.x) + " " + std::to_string(pair.first.y) + " " + std::to_string(pair.second);
+        output += " X"; for (auto pair : counter_x) output += " " + std::to_string(pair.second);
+        output += " Z"; for (auto pair : counter_z) output += " " + std::to_string(pair.second);
+        output += '\n';
+
+    };
+    run_trials_parallel(workers, trial_count, run_trial, [&](const std::string& output) { ofs << output << std::flush; });
     ofs.close();
 }
 
 
 void anomaly_detect_region(std::string filename, int distance, int cycle, uint32_t trial_count, double error_prob, double error_prob_anomaly_ratio, int anomaly_size, int anomaly_pos) {
-    Random random;
-#ifdef _DEBUG
-    unsigned int seed = 0;
-    random.set_seed(seed);
-#else
-    unsigned int seed = random.set_random_seed();
-#endif
+    uint64_t seed = seed_option.get();
 
     ErrorLattice error_lattice(distance, cycle);
     set_error_lattice_uniform(error_prob / 3, error_prob / 3, error_prob / 3, error_lattice);
@@ -305,83 +341,111 @@ void anomaly_detect_region(std::string filename, int distance, int cycle, uint32
     printf("configure finish\n");
 
 
-    Decoder decoder;
-	std::stringstream ss;
-    std::map<Position, int> counter_x, counter_z;
+    // active counts of stabilizers are accumulated in dense arrays indexed by (node index % _num_node_layer)
+    // stabilizers are written in the order of (x, y) position
+    struct StabilizerCounter {
+        const SyndromeLattice& lattice;
+        std::vector<uint32_t> order;
+        std::vector<std::string> prefix;
+        // histogram[index * (cycle + 1) + c] is the number of trials where the stabilizer is active c times
+        std::vector<uint32_t> histogram;
+    };
+    StabilizerCounter counter_x = { syndrome_lattice_x, {}, {}, {} }, counter_z = { syndrome_lattice_z, {}, {}, {} };
+    std::pair<StabilizerCounter*, const char*> counters[] = { {&counter_x, "X"}, {&counter_z, "Z"} };
+    for (auto& item : counters) {
+        StabilizerCounter& counter = *item.first;
+        NodeIndex num_node_layer = counter.lattice._num_node_layer;
+        counter.histogram.assign(num_node_layer * (cycle + 1), 0);
+        for (NodeIndex i = 0; i < num_node_layer; ++i) {
+            Position pos = counter.lattice.index_to_position(i);
+            counter.order.push_back(i);
+            counter.prefix.push_back(std::string(item.second) + " " + std::to_string(pos.x) + " " + std::to_string(pos.y) + " ");
+        }
+        std::sort(counter.order.begin(), counter.order.end(), [&](NodeIndex a, NodeIndex b) {
+            return counter.lattice.index_to_position(a) < counter.lattice.index_to_position(b);
+        });
+    }
+
+    // lattices are shared by workers, and each worker has its own random stream, counts and histograms
+    struct Worker {
+        Random random;
+        std::vector<uint32_t> count[2];
+        std::vector<uint32_t> histogram[2];
+    };
+    std::vector<Worker> workers(thread_option.get());
+    for (auto& worker : workers) {
+        for (int k = 0; k < 2; ++k) {
+            worker.count[k].assign(counters[k].first->lattice._num_node_layer, 0);
+            worker.histogram[k].assign(counters[k].first->histogram.size(), 0);
+        }
+    }
 
-    for (unsigned int i = 0; i < trial_count; ++i) {
+    // counts of each trial are appended to the file in trial order
+    std::ofstream ofs(filename, std::ios::app);
+    auto run_trial = [&](Worker& worker, uint32_t i, std::string& output) {
+        Random& random = worker.random;
+        // each trial uses its own substream
+        random.set_stream(seed, i);
         // create error and parity
-        auto error_info = error_lattice.generate_sample_anomaly_region(random, error_prob_anomaly_ratio, anomaly_size, anomaly_pos);
+        auto error_info = error_lattice.generate_sample_anomaly_region(random, error_prob_anomaly_ratio, anomaly_size, anomaly_pos, true);
         ErrorSample error_sample = error_info.first;
         uint8_t correct_parity = error_info.second;
 
         // create syndrome
-        SyndromeSample detected_nodes_x = syndrome_lattice_x.create_symdrome(error_sample, error_lattice);
-        SyndromeSample detected_nodes_z = syndrome_lattice_z.create_symdrome(error_sample, error_lattice);
-
-        if (counter_x.size() == 0) {
-            for (int i = 0; i < syndrome_lattice_x._num_node-2; ++i) {
-                Position pos = syndrome_lattice_x.index_to_position(i);
-                pos.z = 0;
-                counter_x[pos] = 0;
-            }
-            for (int i = 0; i < syndrome_lattice_z._num_node-2; ++i) {
-                Position pos = syndrome_lattice_z.index_to_position(i);
-                pos.z = 0;
-                counter_z[pos] = 0;
-            }
-        }
-        else {
-            {
-                auto ite = counter_x.begin();
-                while (ite != counter_x.end()) {
-                    ite->second = 0;
-                    ite++;
-                }
-            }
-            {
-                auto ite = counter_z.begin();
-                while (ite != counter_z.end()) {
-                    ite->second = 0;
-                    ite++;
-                }
-            }
-        }
+        SyndromeSample detected_nodes_x, detected_nodes_z;
+        SyndromeLattice::create_symdrome_pair(error_sample, syndrome_lattice_x, syndrome_lattice_z, detected_nodes_x, detected_nodes_z);
 
+        std::vector<uint32_t>& count_x = worker.count[0];
+        std::vector<uint32_t>& count_z = worker.count[1];
+        std::fill(count_x.begin(), count_x.end(), 0);
+        std::fill(count_z.begin(), count_z.end(), 0);
         for (auto value : detected_nodes_x) {
             if (value == syndrome_lattice_x._boundary_main_id || value == syndrome_lattice_x._boundary_sub_id) continue;
-            Position pos = syndrome_lattice_x.index_to_position(value);
-            pos.z = 0;
-            counter_x[pos] += 1;
+            count_x[value % syndrome_lattice_x._num_node_layer]++;
         }
         for (auto value : detected_nodes_z) {
             if (value == syndrome_lattice_z._boundary_main_id || value == syndrome_lattice_z._boundary_sub_id) continue;
-            Position pos = syndrome_lattice_z.index_to_position(value);
-            pos.z = 0;
-            counter_z[pos] += 1;
+            count_z[value % syndrome_lattice_z._num_node_layer]++;
         }
 
-        {
-            auto ite = counter_x.begin();
-            while (ite != counter_x.end()) {
-                ss << "X " << ite->first.x << " " << ite->first.y << " " << ite->second << std::endl;
-                ite++;
+        for (int k = 0; k < 2; ++k) {
+            const StabilizerCounter& counter = *counters[k].first;
+            for (NodeIndex index : counter.order) {
+                output += counter.prefix[index];
+                output += std::to_string(worker.count[k][index]);
+                output += '\n';
+                worker.histogram[k][index * (cycle + 1) + worker.count[k][index]]++;
             }
         }
-        {
-            auto ite = counter_z.begin();
-            while (ite != counter_z.end()) {
-                ss << "Z " << ite->first.x << " " << ite->first.y << " " << ite->second << std::endl;
-                ite++;
+    };
+    run_trials_parallel(workers, trial_count, run_trial, [&](const std::string& output) { ofs << output; });
+    ofs.close();
+
+    for (const auto& worker : workers) {
+        for (int k = 0; k < 2; ++k) {
+            std::vector<uint32_t>& histogram = counters[k].first->histogram;
+            for (size_t j = 0; j < histogram.size(); ++j) histogram[j] += worker.histogram[k][j];
+        }
+    }
+
+    // histogram of active counts aggregated over all the trials: "X_or_Z x y count number_of_trials"
+    std::ofstream ofs_hist(filename + ".hist", std::ios::out);
+    for (auto& item : counters) {
+        StabilizerCounter& counter = *item.first;
+        for (NodeIndex index : counter.order) {
+            for (int c = 0; c <= cycle; ++c) {
+                uint32_t num = counter.histogram[index * (cycle + 1) + c];
+                if (num == 0) continue;
+                ofs_hist << counter.prefix[index] << c << " " << num << "\n";
             }
         }
     }
-    std::ofstream ofs(filename, std::ios::app);
-	ofs << ss.str();
-    ofs.close();
+    ofs_hist.close();
 }
 
 int main(int argc, char** argv) {
+    argc = seed_option.parse(argc, argv);
+    argc = thread_option.parse(argc, argv);
     std::string filename = "test.txt";
     unsigned int distance = 21;
     unsigned int cycle = 10;
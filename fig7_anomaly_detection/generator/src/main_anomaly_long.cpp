@@ -19,8 +19,13 @@
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <memory>
 #include "error_lattice.hpp"
 #include "syndrome_lattice.hpp"
+#include "trajectory_writer.hpp"
+#include "anomaly_detector.hpp"
+
+SeedOption seed_option;
 
 void set_error_lattice_uniform(double error_prob_x, double error_prob_y, double error_prob_z, ErrorLattice& error_lattice) {
 	for (unsigned int z = 0; z < 2 * error_lattice._cycle; ++z) {
@@ -38,13 +43,8 @@ void set_error_lattice_uniform(double error_prob_x, double error_prob_y, double
 }
 
 void anomaly_detect_region_long(std::string filename, int distance, int cycle, uint32_t trial_count, double error_prob, double error_prob_anomaly_ratio, int anomaly_size, int anomaly_pos) {
-    Random random;
-#ifdef _DEBUG
-    unsigned int seed = 0;
-    random.set_seed(seed);
-#else
-    unsigned int seed = random.set_random_seed();
-#endif
+    uint64_t seed = seed_option.get();
+    Random random(seed);
 
     ErrorLattice error_lattice(distance, cycle * 4);
     set_error_lattice_uniform(error_prob / 3, error_prob / 3, error_prob / 3, error_lattice);
@@ -66,34 +66,177 @@ void anomaly_detect_region_long(std::string filename, int distance, int cycle, u
     ofs_pos << ss_pos.str();
     ofs_pos.close();
 
-    std::stringstream ss;
+    // syndromes are written per trial, as packed binary if filename ends with ".bin" and as text otherwise
+    bool binary = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".bin") == 0;
+    std::unique_ptr<TrajectoryWriter> writer;
+    std::ofstream ofs;
+    if (binary) {
+        TrajectoryHeader header = TrajectoryWriter::make_header(distance, cycle * 4, trial_count);
+        header.anomaly_size = anomaly_size;
+        header.anomaly_center = (2 * distance - 1) / 2 + anomaly_pos;
+        header.anomaly_layer_begin = cycle;
+        header.anomaly_layer_end = cycle * 3;
+        header.error_prob = error_prob;
+        header.anomaly_ratio = error_prob_anomaly_ratio;
+        writer.reset(new TrajectoryWriter(filename, header));
+    }
+    else {
+        ofs.open(filename, std::ios::out);
+    }
+
+    std::vector<uint8_t> detected_nodes_x, detected_nodes_z;
     for (unsigned int i = 0; i < trial_count; ++i) {
+        // each trial uses its own substream
+        random.set_stream(seed, i);
         // create error and parity
-        auto error_info = error_lattice.generate_sample_anomaly_region_long(random, error_prob_anomaly_ratio, anomaly_size, anomaly_pos);
+        auto error_info = error_lattice.generate_sample_anomaly_region_long(random, error_prob_anomaly_ratio, anomaly_size, anomaly_pos, true);
         ErrorSample error_sample = error_info.first;
         uint8_t correct_parity = error_info.second;
 
         // create syndrome
-        auto detected_nodes_x = syndrome_lattice_x.create_symdrome_return_list(error_sample, error_lattice);
-        auto detected_nodes_z = syndrome_lattice_z.create_symdrome_return_list(error_sample, error_lattice);
+        SyndromeLattice::create_symdrome_return_list_pair(error_sample, syndrome_lattice_x, syndrome_lattice_z, detected_nodes_x, detected_nodes_z);
 
-        for (int i = 0; i < detected_nodes_x.size(); ++i) {
-            ss << (int)(detected_nodes_x[i]);
-            if (i + 1 < detected_nodes_x.size()) ss << " ";
+        if (binary) {
+            writer->write_trial(detected_nodes_x, detected_nodes_z);
+            continue;
+        }
+        std::string line;
+        line.reserve(2 * (detected_nodes_x.size() + detected_nodes_z.size()));
+        for (uint8_t v : detected_nodes_x) {
+            line += (char)('0' + v);
+            line += ' ';
         }
-        ss << " ";
-        for (int i = 0; i < detected_nodes_z.size(); ++i) {
-            ss << (int)(detected_nodes_z[i]);
-            if (i + 1 < detected_nodes_z.size()) ss << " ";
+        for (size_t i = 0; i < detected_nodes_z.size(); ++i) {
+            line += (char)('0' + detected_nodes_z[i]);
+            line += (i + 1 < detected_nodes_z.size()) ? ' ' : '\n';
+        }
+        ofs << line;
+    }
+    if (binary) writer->close();
+    else ofs.close();
+}
+
+// run sliding-window detectors of several window sizes on the fly, and report latency and position error of detection
+void anomaly_detect_region_online(std::string filename, int distance, int cycle, uint32_t trial_count, double error_prob, double error_prob_anomaly_ratio, int anomaly_size, int anomaly_pos,
+    const std::vector<uint32_t>& window_sizes, double confidence, uint32_t min_above_count) {
+    uint64_t seed = seed_option.get();
+    Random random(seed);
+
+    ErrorLattice error_lattice(distance, cycle * 4);
+    set_error_lattice_uniform(error_prob / 3, error_prob / 3, error_prob / 3, error_lattice);
+
+    SyndromeLatticeX syndrome_lattice_x(distance, cycle * 4);
+    SyndromeLatticeZ syndrome_lattice_z(distance, cycle * 4);
+    const uint32_t num_layer = cycle * 4;
+    const uint32_t num_node_layer = syndrome_lattice_x._num_node_layer;
+    assert(num_node_layer == syndrome_lattice_z._num_node_layer);
+
+    // stabilizers of a layer are X nodes followed by Z nodes
+    // flip probabilities are taken from a middle layer, which has the same incident edges as all the layers except for the first and last ones
+    std::vector<StabilizerNoise> noise;
+    std::vector<Position> stabilizer_pos;
+    uint32_t middle = (num_layer / 2) * num_node_layer;
+    for (uint32_t i = 0; i < num_node_layer; ++i) {
+        auto prob = syndrome_lattice_x.layer_flip_probability(error_lattice, middle + i);
+        noise.push_back({ prob.first, prob.second });
+        stabilizer_pos.push_back(syndrome_lattice_x.index_to_position(i));
+    }
+    for (uint32_t i = 0; i < num_node_layer; ++i) {
+        auto prob = syndrome_lattice_z.layer_flip_probability(error_lattice, middle + i);
+        noise.push_back({ prob.first, prob.second });
+        stabilizer_pos.push_back(syndrome_lattice_z.index_to_position(i));
+    }
+
+    // a detector is checked at every layer, so min_above_count must keep the false alarms of the whole scan rare
+    std::vector<SlidingWindowDetector> detectors;
+    for (uint32_t window_size : window_sizes) {
+        detectors.emplace_back(window_size, noise, confidence, min_above_count);
+        const SlidingWindowDetector& detector = detectors.back();
+        double scan_false_alarm = detector.scan_false_alarm_bound(num_layer);
+        printf("window=%u window_false_alarm=%le scan_false_alarm_bound=%le\n", window_size, detector.window_false_alarm(), scan_false_alarm);
+        if (scan_false_alarm > 1. - confidence) {
+            fprintf(stderr, "warning: window=%u fires without anomaly in a scan of %u layers with probability up to %le; min_above_count >= %u is required for %le\n",
+                window_size, num_layer, scan_false_alarm, detector.required_min_above_count(num_layer, 1. - confidence), 1. - confidence);
         }
-        ss << std::endl;
     }
+
+    // the anomalous region appears at layer `cycle`
+    const double center = (2 * distance - 1) / 2 + anomaly_pos;
+    const int onset = cycle;
+
+    // detection_layer, latency, and the mean position are nan if the detector does not fire
+    //  detections before the onset (negative latency) are false alarms, and so are all the detections if anomaly_ratio is 1
+    const bool no_anomaly = (error_prob_anomaly_ratio <= 1.);
     std::ofstream ofs(filename, std::ios::out);
-    ofs << ss.str();
+    ofs << "# window trial detected detection_layer latency mean_x mean_y" << std::endl;
+    std::vector<uint32_t> detected_count(window_sizes.size(), 0);
+    std::vector<uint32_t> false_alarm_count(window_sizes.size(), 0);
+    std::vector<double> latency_sum(window_sizes.size(), 0.);
+    std::vector<double> position_error_sum(window_sizes.size(), 0.);
+
+    std::vector<uint8_t> detected_nodes_x, detected_nodes_z;
+    std::vector<uint8_t> layer_syndrome(num_node_layer * 2);
+    for (unsigned int trial = 0; trial < trial_count; ++trial) {
+        // each trial uses its own substream
+        random.set_stream(seed, trial);
+        auto error_info = error_lattice.generate_sample_anomaly_region_long(random, error_prob_anomaly_ratio, anomaly_size, anomaly_pos, true);
+        SyndromeLattice::create_symdrome_return_list_pair(error_info.first, syndrome_lattice_x, syndrome_lattice_z, detected_nodes_x, detected_nodes_z);
+
+        std::vector<uint8_t> detected(detectors.size(), 0);
+        std::vector<int> detection_layer(detectors.size(), 0);
+        std::vector<double> mean_x(detectors.size(), 0.), mean_y(detectors.size(), 0.);
+        for (auto& detector : detectors) detector.reset();
+        size_t remaining = detectors.size();
+        for (uint32_t layer = 0; layer < num_layer && remaining > 0; ++layer) {
+            std::copy(detected_nodes_x.begin() + layer * num_node_layer, detected_nodes_x.begin() + (layer + 1) * num_node_layer, layer_syndrome.begin());
+            std::copy(detected_nodes_z.begin() + layer * num_node_layer, detected_nodes_z.begin() + (layer + 1) * num_node_layer, layer_syndrome.begin() + num_node_layer);
+            for (size_t k = 0; k < detectors.size(); ++k) {
+                if (detected[k]) continue;
+                if (!detectors[k].push_layer(layer_syndrome.data())) continue;
+
+                // the window ends at layer, and the detection happens at the next layer
+                detected[k] = 1;
+                detection_layer[k] = layer + 1;
+                remaining--;
+                uint32_t count = 0;
+                for (uint32_t i = 0; i < num_node_layer * 2; ++i) {
+                    if (!detectors[k].is_above(i)) continue;
+                    mean_x[k] += stabilizer_pos[i].x;
+                    mean_y[k] += stabilizer_pos[i].y;
+                    count++;
+                }
+                mean_x[k] /= count;
+                mean_y[k] /= count;
+            }
+        }
+
+        for (size_t k = 0; k < detectors.size(); ++k) {
+            if (!detected[k]) {
+                ofs << window_sizes[k] << " " << trial << " 0 nan nan nan nan\n";
+                continue;
+            }
+            int latency = detection_layer[k] - onset;
+            ofs << window_sizes[k] << " " << trial << " 1 " << detection_layer[k] << " " << latency << " " << mean_x[k] << " " << mean_y[k] << "\n";
+            if (latency < 0 || no_anomaly) {
+                false_alarm_count[k]++;
+                continue;
+            }
+            detected_count[k]++;
+            latency_sum[k] += latency;
+            position_error_sum[k] += std::sqrt((mean_x[k] - center) * (mean_x[k] - center) + (mean_y[k] - center) * (mean_y[k] - center));
+        }
+    }
     ofs.close();
+
+    // latency and position error are averaged over the detections after the onset
+    for (size_t k = 0; k < detectors.size(); ++k) {
+        printf("window=%u detected=%u/%u false_alarm=%u/%u mean_latency=%lf mean_position_error=%lf\n", window_sizes[k], detected_count[k], trial_count,
+            false_alarm_count[k], trial_count, latency_sum[k] / std::max(1u, detected_count[k]), position_error_sum[k] / std::max(1u, detected_count[k]));
+    }
 }
 
 int main(int argc, char** argv) {
+    argc = seed_option.parse(argc, argv);
     std::string filename = "test.txt";
     unsigned int distance = 21;
     unsigned int cycle = 10;
@@ -103,10 +246,23 @@ int main(int argc, char** argv) {
     double error_prob_anomaly_ratio = 1e2;
     int anomaly_pos = 5;
 
-    if (argc >= 2 && argc != 9) {
+    // online detection mode
+    std::vector<uint32_t> window_sizes;
+    double confidence = 0.99;
+    uint32_t min_above_count = 20;
+
+    if (argc >= 2 && argc != 9 && argc != 12) {
         printf("filename, distance, cycle, trial_count, error_prob, anomaly_ratio, anomaly_size, anomaly_pos\n");
+        printf("filename, distance, cycle, trial_count, error_prob, anomaly_ratio, anomaly_size, anomaly_pos, window_sizes(comma separated), confidence, min_above_count\n");
         exit(0);
     }
+    if (argc == 12) {
+        std::stringstream ss(argv[9]);
+        std::string item;
+        while (std::getline(ss, item, ',')) window_sizes.push_back(atoi(item.c_str()));
+        confidence = atof(argv[10]);
+        min_above_count = atoi(argv[11]);
+    }
     if (argc >= 2) {
         filename = std::string(argv[1]);
         distance = atoi(argv[2]);
@@ -119,6 +275,9 @@ int main(int argc, char** argv) {
     }
     printf("distance=%d cycle=%d trial_count=%d\n", distance, cycle, trial_count);
 
-    anomaly_detect_region_long(filename, distance, cycle, trial_count, error_prob, error_prob_anomaly_ratio, anomaly_size, anomaly_pos);
+    if (window_sizes.size() > 0)
+        anomaly_detect_region_online(filename, distance, cycle, trial_count, error_prob, error_prob_anomaly_ratio, anomaly_size, anomaly_pos, window_sizes, confidence, min_above_count);
+    else
+        anomaly_detect_region_long(filename, distance, cycle, trial_count, error_prob, error_prob_anomaly_ratio, anomaly_size, anomaly_pos);
 }
 
@@ -7,7 +7,7 @@
 class SyndromeLatticeX : public SyndromeLattice{
 public:
 	SyndromeLatticeX(uint32_t distance, uint32_t cycle)
-		: SyndromeLattice(distance, cycle, 1, 0, distance-1)
+		: SyndromeLattice(distance, cycle, 1, 0, distance-1, 1)
 	{}
 	virtual ~SyndromeLatticeX() {};
 
@@ -47,7 +47,7 @@ public:
 class SyndromeLatticeZ : public SyndromeLattice {
 public:
 	SyndromeLatticeZ(uint32_t distance, uint32_t cycle)
-		: SyndromeLattice(distance, cycle, 0, 1, distance)
+		: SyndromeLattice(distance, cycle, 0, 1, distance, 2)
 	{}
 	virtual ~SyndromeLatticeZ() {};
 
@@ -2,38 +2,220 @@
 
 #pragma once
 
+#include <algorithm>
 #include <vector>
+#include <deque>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <queue>
+#include <tuple>
+#include <unordered_map>
 #include "error_lattice.hpp"
 
 using WeightType = double;
-using WeightedGraph = std::vector<std::vector<WeightType>>;
 using NodeIndex = uint32_t;
 using SyndromeSample = std::vector<NodeIndex>;
 
 class SyndromeLattice {
 protected:
 	const WeightType weight_inf = 1<<29;
-	WeightedGraph _weighted_graph;
-	WeightedGraph _weighted_graph_no_boundary;
-	WeightedGraph _weighted_graph_two_boundary;
-
-	void warshall_floyd(WeightedGraph& graph) const {
-		assert(graph.size() == _num_node);
-		for (unsigned int i = 0; i < _num_node; i++) {
-			for (unsigned int j = 0; j < _num_node; j++) {
-				for (unsigned int k = 0; k < _num_node; k++) {
-					double dec = graph[j][i] + graph[i][k];;
-					if (graph[j][k] > dec) {
-						graph[j][k] = dec;
-						graph[k][j] = dec;
+
+	// distances are not materialized as matrices but evaluated on demand
+	//  uniform: closed form from positions, weighted: shortest-path rows of queried nodes are cached
+	enum class WeightMode { none, uniform, weighted };
+	WeightMode _weight_mode = WeightMode::none;
+	bool _unit_weight = false;
+
+	// sparse 6-neighbour lattice in CSR format, built in create_weighted_graph
+	std::vector<uint32_t> _adjacency_offset;
+	std::vector<NodeIndex> _adjacency_target;
+	std::vector<WeightType> _adjacency_weight;
+
+	// how two boundary nodes are treated in shortest-path search
+	//  joined: connected with zero weight, separate: not connected, isolated: all the edges to them are removed
+	enum class BoundaryMode { joined, separate, isolated };
+
+	bool _is_boundary(NodeIndex index) const {
+		return index == _boundary_main_id || index == _boundary_sub_id;
+	}
+
+	// single-source shortest paths over the sparse lattice
+	// Dijkstra with a binary heap for general weights, and 0-1 BFS when all the edge weights are one
+	void shortest_path(NodeIndex source, BoundaryMode mode, bool unit_weight, std::vector<WeightType>& dist) const {
+		dist.assign(_num_node, weight_inf);
+		dist[source] = 0;
+		if (mode == BoundaryMode::isolated && _is_boundary(source)) return;
+
+		// call relax(target, weight) for every edge from node
+		auto for_each_edge = [&](NodeIndex node, auto&& relax) {
+			for (uint32_t e = _adjacency_offset[node]; e < _adjacency_offset[node + 1]; ++e) {
+				NodeIndex target = _adjacency_target[e];
+				if (mode == BoundaryMode::isolated && _is_boundary(target)) continue;
+				relax(target, _adjacency_weight[e]);
+			}
+			if (mode == BoundaryMode::joined && _is_boundary(node)) {
+				relax(node == _boundary_main_id ? _boundary_sub_id : _boundary_main_id, 0);
+			}
+		};
+
+		if (unit_weight) {
+			std::deque<NodeIndex> queue;
+			queue.push_back(source);
+			std::vector<uint8_t> done(_num_node, 0);
+			while (!queue.empty()) {
+				NodeIndex node = queue.front();
+				queue.pop_front();
+				if (done[node]) continue;
+				done[node] = 1;
+				for_each_edge(node, [&](NodeIndex target, WeightType weight) {
+					if (dist[node] + weight < dist[target]) {
+						dist[target] = dist[node] + weight;
+						if (weight == 0) queue.push_front(target);
+						else queue.push_back(target);
 					}
-				}
+				});
+			}
+		}
+		else {
+			using Item = std::pair<WeightType, NodeIndex>;
+			std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+			queue.push(Item(0, source));
+			while (!queue.empty()) {
+				Item item = queue.top();
+				queue.pop();
+				NodeIndex node = item.second;
+				if (item.first > dist[node]) continue;
+				for_each_edge(node, [&](NodeIndex target, WeightType weight) {
+					if (dist[node] + weight < dist[target]) {
+						dist[target] = dist[node] + weight;
+						queue.push(Item(dist[target], target));
+					}
+				});
 			}
 		}
 	}
 
-	virtual void set_weight(WeightedGraph& graph, NodeIndex n1, NodeIndex n2, WeightType weight) const {
-		graph[n1][n2] = graph[n2][n1] = weight;
+	// incident error edges of each node in CSR format, built in constructor
+	//  syndrome of node i is the parity of error_sample[_stencil_edge[j]] for j in [_stencil_offset[i], _stencil_offset[i+1])
+	std::vector<uint32_t> _stencil_offset;
+	std::vector<EdgeIndex> _stencil_edge;
+	EdgeIndex _stencil_num_error_edge;
+	// bit of ErrorSample flipped by the errors detected with this lattice
+	const uint8_t _error_mask;
+
+	void _build_stencil() {
+		const int8_t dx[] = { -1,1,0,0,0,0 };
+		const int8_t dy[] = { 0,0,-1,1,0,0 };
+		const int8_t dz[] = { 0,0,0,0,-1,1 };
+		const uint8_t direction = 6;
+
+		ErrorLattice error_lattice(_distance, _cycle);
+		_stencil_num_error_edge = error_lattice.get_num_edge();
+		_stencil_offset.assign(1, 0);
+		_stencil_edge.clear();
+		for (NodeIndex index = 0; index < _num_node - 2; ++index) {
+			Position pos = SyndromeLattice::index_to_position(index);
+			for (uint8_t dir = 0; dir < direction; ++dir) {
+				Position edge_pos(pos);
+				edge_pos.x += dx[dir];
+				edge_pos.y += dy[dir];
+				edge_pos.z += dz[dir];
+				if (!error_lattice.is_exist(edge_pos, false)) continue;
+				_stencil_edge.push_back(error_lattice.position_to_index(edge_pos, true));
+			}
+			_stencil_offset.push_back((uint32_t)_stencil_edge.size());
+		}
+	}
+
+	// gather-XOR of incident edges
+	bool _syndrome_bit(const uint8_t* error, NodeIndex index) const {
+		uint8_t synd = 0;
+		for (uint32_t j = _stencil_offset[index]; j < _stencil_offset[index + 1]; ++j) {
+			synd ^= error[_stencil_edge[j]];
+		}
+		return (synd & _error_mask) != 0;
+	}
+
+	// LRU cache of shortest-path rows, keyed by (boundary mode, source)
+	using RowKey = uint64_t;
+	using RowList = std::list<std::pair<RowKey, std::vector<WeightType>>>;
+	mutable RowList _row_list;
+	mutable std::unordered_map<RowKey, RowList::iterator> _row_map;
+	mutable std::mutex _row_mutex;
+	size_t _row_cache_limit = ((size_t)256) << 20;
+
+	// call read(row) with the shortest-path row of source, which is computed and cached if missing
+	template <class Reader>
+	void _read_distance_row(BoundaryMode mode, NodeIndex source, Reader read) const {
+		RowKey key = ((RowKey)mode) * _num_node + source;
+		{
+			std::lock_guard<std::mutex> lock(_row_mutex);
+			auto it = _row_map.find(key);
+			if (it != _row_map.end()) {
+				_row_list.splice(_row_list.begin(), _row_list, it->second);
+				read(it->second->second);
+				return;
+			}
+		}
+		std::vector<WeightType> dist;
+		shortest_path(source, mode, _unit_weight, dist);
+		read(dist);
+
+		std::lock_guard<std::mutex> lock(_row_mutex);
+		if (_row_map.find(key) == _row_map.end()) {
+			_row_list.emplace_front(key, std::move(dist));
+			_row_map[key] = _row_list.begin();
+			size_t max_row_count = std::max((size_t)1, _row_cache_limit / (sizeof(WeightType) * _num_node));
+			while (_row_list.size() > max_row_count) {
+				_row_map.erase(_row_list.back().first);
+				_row_list.pop_back();
+			}
+		}
+	}
+
+	// distance between n1 and n2 on the weighted lattice
+	//  the row of the smaller index is always used, so that the weight is exactly symmetric
+	WeightType _weighted_distance(BoundaryMode mode, NodeIndex n1, NodeIndex n2) const {
+		if (n2 < n1) std::swap(n1, n2);
+		WeightType weight;
+		_read_distance_row(mode, n1, [&](const std::vector<WeightType>& row) { weight = row[n2]; });
+		return weight;
+	}
+
+	// distance between n1 and n2 on the uniform lattice, which is a Manhattan distance or a path via boundaries
+	WeightType _uniform_distance(BoundaryMode mode, NodeIndex n1, NodeIndex n2) const {
+		if (n2 < n1) std::swap(n1, n2);
+		if (_is_boundary(n1)) {
+			// both are boundaries
+			if (n1 == n2) return weight_inf;
+			if (mode == BoundaryMode::joined) return 0;
+			if (mode == BoundaryMode::separate) return _distance;
+			return weight_inf;
+		}
+		if (n1 == n2) return 0;
+		Position pos1 = index_to_position(n1);
+		WeightType main1 = count_edge_num_to_main_boundary(pos1);
+		WeightType sub1 = count_edge_num_to_sub_boundary(pos1);
+		if (_is_boundary(n2)) {
+			if (mode == BoundaryMode::joined) return std::min(main1, sub1);
+			if (mode == BoundaryMode::separate) return (n2 == _boundary_main_id) ? main1 : sub1;
+			return weight_inf;
+		}
+		Position pos2 = index_to_position(n2);
+		WeightType mahattan_cost = count_edge_num_between_nodes(pos1, pos2);
+		if (mode == BoundaryMode::isolated) return mahattan_cost;
+		WeightType main2 = count_edge_num_to_main_boundary(pos2);
+		WeightType sub2 = count_edge_num_to_sub_boundary(pos2);
+		if (mode == BoundaryMode::joined) return std::min(mahattan_cost, std::min(main1, sub1) + std::min(main2, sub2));
+		return std::min(mahattan_cost, std::min(main1 + main2, sub1 + sub2));
+	}
+
+	WeightType _distance_oracle(BoundaryMode mode, NodeIndex n1, NodeIndex n2) const {
+		assert(n1 < _num_node && n2 < _num_node);
+		assert(_weight_mode != WeightMode::none);
+		if (_weight_mode == WeightMode::uniform) return _uniform_distance(mode, n1, n2);
+		return _weighted_distance(mode, n1, n2);
 	}
 
 public:
@@ -48,8 +230,8 @@ public:
 	const uint32_t _offset_x;
 	const uint32_t _offset_y;
 
-	SyndromeLattice(uint32_t distance, uint32_t cycle, uint32_t offset_x, uint32_t offset_y, uint32_t num_node_width)
-		: _distance(distance), _cycle(cycle),
+	SyndromeLattice(uint32_t distance, uint32_t cycle, uint32_t offset_x, uint32_t offset_y, uint32_t num_node_width, uint8_t error_mask)
+		: _error_mask(error_mask), _distance(distance), _cycle(cycle),
 		_num_node((distance - 1)*distance*cycle + 2),
 		_num_node_layer((distance - 1)*distance),
 		_boundary_main_id((distance - 1)*distance*cycle),
@@ -58,6 +240,7 @@ public:
 	{
 		assert(distance > 0);
 		assert(cycle > 0);
+		_build_stencil();
 	}
 	virtual ~SyndromeLattice() {}
 
@@ -107,30 +290,12 @@ public:
 	virtual double extract_error_weight(const ErrorLattice& error_sample, EdgeIndex edge_index) const = 0;
 
 
-	virtual SyndromeSample create_symdrome(const ErrorSample& error_sample, const ErrorLattice& error_lattice) const {
-		// create syndrome
-		const int8_t dx[] = { -1,1,0,0,0,0 };
-		const int8_t dy[] = { 0,0,-1,1,0,0 };
-		const int8_t dz[] = { 0,0,0,0,-1,1 };
-		uint8_t direction = 6;
-
+	virtual SyndromeSample create_symdrome(const ErrorSample& error_sample, const ErrorLattice&) const {
+		assert(error_sample.size() == _stencil_num_error_edge);
 		SyndromeSample detected_nodes;
-		for (NodeIndex index = 0; index < _num_node; ++index) {
-			if (index == _boundary_main_id || index == _boundary_sub_id) continue;
-
-			Position pos = index_to_position(index);
-			bool synd = false;
-			for (uint8_t dir = 0; dir < direction; ++dir) {
-				Position edge_pos(pos);
-				edge_pos.x += dx[dir];
-				edge_pos.y += dy[dir];
-				edge_pos.z += dz[dir];
-				if (!error_lattice.is_exist(edge_pos, false)) continue;
-				//printf("(%d,%d,%d)->(%d,%d,%d)\n", edge_pos.x, edge_pos.y, edge_pos.z, org_pos.x,org_pos.y,org_pos.z );
-				EdgeIndex edge_index = error_lattice.position_to_index(edge_pos, true);
-				synd ^= extract_error_bit(error_sample, edge_index);
-			}
-			if (synd) {
+		const uint8_t* error = error_sample.data();
+		for (NodeIndex index = 0; index < _num_node - 2; ++index) {
+			if (_syndrome_bit(error, index)) {
 				detected_nodes.push_back(index);
 			}
 		}
@@ -140,33 +305,69 @@ public:
 		return detected_nodes;
 	}
 
-    virtual std::vector<uint8_t> create_symdrome_return_list(const ErrorSample& error_sample, const ErrorLattice& error_lattice) const {
-        // create syndrome
-        const int8_t dx[] = { -1,1,0,0,0,0 };
-        const int8_t dy[] = { 0,0,-1,1,0,0 };
-        const int8_t dz[] = { 0,0,0,0,-1,1 };
-        uint8_t direction = 6;
-
-        std::vector<uint8_t> node_list;
-        for (NodeIndex index = 0; index < _num_node; ++index) {
-            if (index == _boundary_main_id || index == _boundary_sub_id) continue;
-
-            Position pos = index_to_position(index);
-            bool synd = false;
-            for (uint8_t dir = 0; dir < direction; ++dir) {
-                Position edge_pos(pos);
-                edge_pos.x += dx[dir];
-                edge_pos.y += dy[dir];
-                edge_pos.z += dz[dir];
-                if (!error_lattice.is_exist(edge_pos, false)) continue;
-                //printf("(%d,%d,%d)->(%d,%d,%d)\n", edge_pos.x, edge_pos.y, edge_pos.z, org_pos.x,org_pos.y,org_pos.z );
-                EdgeIndex edge_index = error_lattice.position_to_index(edge_pos, true);
-                synd ^= extract_error_bit(error_sample, edge_index);
-            }
-            node_list.push_back(synd);
-        }
-        return node_list;
-    }
+	virtual std::vector<uint8_t> create_symdrome_return_list(const ErrorSample& error_sample, const ErrorLattice&) const {
+		assert(error_sample.size() == _stencil_num_error_edge);
+		std::vector<uint8_t> node_list(_num_node - 2);
+		const uint8_t* error = error_sample.data();
+		for (NodeIndex index = 0; index < _num_node - 2; ++index) {
+			node_list[index] = _syndrome_bit(error, index);
+		}
+		return node_list;
+	}
+
+	// flip probabilities of the syndrome of node index in the bulk, split into the incident edges shared with the same stabilizer
+	//  in the next layer (time, e.g., measurement errors) and the edges that only flip the syndrome of this layer (space).
+	//  edges shared with the previous layer are the time edges of the previous layer, and are not counted.
+	//  returns (space, time), where each value is the probability that odd number of the edges flip the bit observed by this lattice
+	std::pair<double, double> layer_flip_probability(const ErrorLattice& error_lattice, NodeIndex index) const {
+		assert(index >= _num_node_layer && index + _num_node_layer < _num_node - 2);
+		auto stencil = [&](NodeIndex node) {
+			std::vector<EdgeIndex> edges(_stencil_edge.begin() + _stencil_offset[node], _stencil_edge.begin() + _stencil_offset[node + 1]);
+			std::sort(edges.begin(), edges.end());
+			return edges;
+		};
+		std::vector<EdgeIndex> prev = stencil(index - _num_node_layer);
+		std::vector<EdgeIndex> next = stencil(index + _num_node_layer);
+		double even_space = 1.;
+		double even_time = 1.;
+		for (uint32_t j = _stencil_offset[index]; j < _stencil_offset[index + 1]; ++j) {
+			EdgeIndex edge = _stencil_edge[j];
+			double factor = 1. - 2. * extract_error_weight(error_lattice, edge);
+			if (std::binary_search(next.begin(), next.end(), edge)) even_time *= factor;
+			else if (!std::binary_search(prev.begin(), prev.end(), edge)) even_space *= factor;
+		}
+		return std::make_pair((1. - even_space) / 2., (1. - even_time) / 2.);
+	}
+
+	// extract syndromes of two lattices (X and Z) in a single sweep over the error sample
+	static void create_symdrome_pair(const ErrorSample& error_sample, const SyndromeLattice& lattice1, const SyndromeLattice& lattice2,
+		SyndromeSample& detected_nodes1, SyndromeSample& detected_nodes2) {
+		assert(error_sample.size() == lattice1._stencil_num_error_edge);
+		assert(error_sample.size() == lattice2._stencil_num_error_edge);
+		detected_nodes1.clear();
+		detected_nodes2.clear();
+		const uint8_t* error = error_sample.data();
+		NodeIndex num_node = std::max(lattice1._num_node, lattice2._num_node) - 2;
+		for (NodeIndex index = 0; index < num_node; ++index) {
+			if (index < lattice1._num_node - 2 && lattice1._syndrome_bit(error, index)) detected_nodes1.push_back(index);
+			if (index < lattice2._num_node - 2 && lattice2._syndrome_bit(error, index)) detected_nodes2.push_back(index);
+		}
+		if (detected_nodes1.size() % 2 == 1) detected_nodes1.push_back(lattice1._boundary_main_id);
+		if (detected_nodes2.size() % 2 == 1) detected_nodes2.push_back(lattice2._boundary_main_id);
+	}
+	static void create_symdrome_return_list_pair(const ErrorSample& error_sample, const SyndromeLattice& lattice1, const SyndromeLattice& lattice2,
+		std::vector<uint8_t>& node_list1, std::vector<uint8_t>& node_list2) {
+		assert(error_sample.size() == lattice1._stencil_num_error_edge);
+		assert(error_sample.size() == lattice2._stencil_num_error_edge);
+		node_list1.resize(lattice1._num_node - 2);
+		node_list2.resize(lattice2._num_node - 2);
+		const uint8_t* error = error_sample.data();
+		NodeIndex num_node = std::max(lattice1._num_node, lattice2._num_node) - 2;
+		for (NodeIndex index = 0; index < num_node; ++index) {
+			if (index < lattice1._num_node - 2) node_list1[index] = lattice1._syndrome_bit(error, index);
+			if (index < lattice2._num_node - 2) node_list2[index] = lattice2._syndrome_bit(error, index);
+		}
+	}
 
 	virtual void create_weighted_graph(const ErrorLattice& error_lattice, bool uniform_weight = false) {
 		const int8_t dx[] = { -2,2,0,0,0,0 };
@@ -174,8 +375,8 @@ public:
 		const int8_t dz[] = { 0,0,0,0,-2,2 };
 		const uint8_t direction = 6;
 
-		_weighted_graph.clear();
-		_weighted_graph.resize(_num_node, std::vector<WeightType>(_num_node, weight_inf));
+		// collect edges of the sparse lattice
+		std::vector<std::tuple<NodeIndex, NodeIndex, WeightType>> edge_list;
 		for (NodeIndex index = 0; index < _num_node - 2; ++index) {
 			auto pos = index_to_position(index);
 			for (uint8_t dir = 0; dir < direction; ++dir) {
@@ -207,95 +408,87 @@ public:
 				if (prob == 0.) continue;
 
 				assert(targ_index != index);
-				assert(targ_index > index || _weighted_graph[targ_index][index] != weight_inf);
 				if (targ_index > index) {
-					if (uniform_weight) {
-						set_weight(_weighted_graph, index, targ_index, 1);
-					}
-					else {
-						set_weight(_weighted_graph, index, targ_index, -log(prob));
-					}
+					edge_list.push_back(std::make_tuple(index, targ_index, uniform_weight ? 1. : -log(prob)));
 				}
 			}
 		}
 
-		// in normal weighted graph, left and right boundary is the same node
-		set_weight(_weighted_graph, _boundary_main_id, _boundary_sub_id, 0);
-
-		// in two_boundary graph, there are two boundary nodes, but they are not connected
-		_weighted_graph_two_boundary = _weighted_graph;
-		set_weight(_weighted_graph_two_boundary, _boundary_main_id, _boundary_sub_id, weight_inf);
-
-		// in no_boundary graph, two boundary nodes are isolated
-		_weighted_graph_no_boundary = _weighted_graph_two_boundary;
-		for (NodeIndex index = 0; index < _num_node; ++index) {
-			if (index != _boundary_main_id)
-				set_weight(_weighted_graph_no_boundary, _boundary_main_id, index, weight_inf);
-			if (index != _boundary_sub_id)
-				set_weight(_weighted_graph_no_boundary, _boundary_sub_id, index, weight_inf);
+		// build adjacency in CSR format
+		_adjacency_offset.assign(_num_node + 1, 0);
+		for (const auto& edge : edge_list) {
+			_adjacency_offset[std::get<0>(edge) + 1]++;
+			_adjacency_offset[std::get<1>(edge) + 1]++;
+		}
+		for (NodeIndex index = 0; index < _num_node; ++index) _adjacency_offset[index + 1] += _adjacency_offset[index];
+		_adjacency_target.resize(_adjacency_offset[_num_node]);
+		_adjacency_weight.resize(_adjacency_offset[_num_node]);
+		std::vector<uint32_t> fill(_adjacency_offset.begin(), _adjacency_offset.end() - 1);
+		for (const auto& edge : edge_list) {
+			NodeIndex n1 = std::get<0>(edge);
+			NodeIndex n2 = std::get<1>(edge);
+			_adjacency_target[fill[n1]] = n2;
+			_adjacency_weight[fill[n1]++] = std::get<2>(edge);
+			_adjacency_target[fill[n2]] = n1;
+			_adjacency_weight[fill[n2]++] = std::get<2>(edge);
 		}
 
-		warshall_floyd(_weighted_graph);
-		warshall_floyd(_weighted_graph_two_boundary);
-		warshall_floyd(_weighted_graph_no_boundary);
+		// rows of shortest paths are computed when they are queried
+		clear_distance_cache();
+		_unit_weight = uniform_weight;
+		_weight_mode = WeightMode::weighted;
 	}
 
 	virtual void create_weighted_graph_uniform() {
-		_weighted_graph.clear();
-		_weighted_graph.resize(_num_node, std::vector<WeightType>(_num_node, weight_inf));
-		for (NodeIndex n1 = 0; n1 < _num_node - 2; ++n1) {
-			Position pos1 = index_to_position(n1);
-			WeightType distance_to_main = count_edge_num_to_main_boundary(pos1);
-			WeightType distance_to_sub = count_edge_num_to_sub_boundary(pos1);
-			set_weight(_weighted_graph, n1, _boundary_main_id, distance_to_main);
-			set_weight(_weighted_graph, n1, _boundary_sub_id, distance_to_sub);
-			set_weight(_weighted_graph, n1, n1, 0);
-		}
-		_weighted_graph_two_boundary = _weighted_graph;
-		_weighted_graph_no_boundary = _weighted_graph;
-
-		for (NodeIndex n1 = 0; n1 < _num_node - 2; ++n1) {
-			for (NodeIndex n2 = n1 + 1; n2 < _num_node - 2; ++n2) {
-				Position pos1 = index_to_position(n1);
-				Position pos2 = index_to_position(n2);
-				WeightType mahattan_cost = count_edge_num_between_nodes(pos1, pos2);
-				WeightType boundary_cost_main1 = _weighted_graph[n1][_boundary_main_id];
-				WeightType boundary_cost_sub1 = _weighted_graph[n1][_boundary_sub_id];
-				WeightType boundary_cost_main2 = _weighted_graph[n2][_boundary_main_id];
-				WeightType boundary_cost_sub2 = _weighted_graph[n2][_boundary_sub_id];
-				WeightType boundary_cost = std::min(boundary_cost_main1, boundary_cost_sub1) + std::min(boundary_cost_main2, boundary_cost_sub2);
-				WeightType boundary_cost_separate = std::min(boundary_cost_main1 + boundary_cost_main2, boundary_cost_sub1 + boundary_cost_sub2);
-				set_weight(_weighted_graph, n1, n2, std::min(mahattan_cost, boundary_cost));
-				set_weight(_weighted_graph_two_boundary, n1, n2, std::min(mahattan_cost, boundary_cost_separate));
-				set_weight(_weighted_graph_no_boundary, n1, n2, mahattan_cost);
-			}
-		}
-		for (NodeIndex n1 = 0; n1 < _num_node - 2; ++n1) {
-			Position pos1 = index_to_position(n1);
-			WeightType distance_to_main = count_edge_num_to_main_boundary(pos1);
-			WeightType distance_to_sub = count_edge_num_to_sub_boundary(pos1);
-			WeightType distance_to_boundary = std::min(distance_to_main, distance_to_sub);
-			set_weight(_weighted_graph, n1, _boundary_main_id, distance_to_boundary);
-			set_weight(_weighted_graph, n1, _boundary_sub_id, distance_to_boundary);
-			set_weight(_weighted_graph_no_boundary, n1, _boundary_main_id, weight_inf);
-			set_weight(_weighted_graph_no_boundary, n1, _boundary_sub_id, weight_inf);
-		}
-		// in normal weighted graph, left and right boundary is the same node
-		set_weight(_weighted_graph, _boundary_main_id, _boundary_sub_id, 0);
-		set_weight(_weighted_graph_two_boundary, _boundary_main_id, _boundary_sub_id, _distance);
-		set_weight(_weighted_graph_no_boundary, _boundary_main_id, _boundary_sub_id, weight_inf);
+		// distances are given in closed form
+		clear_distance_cache();
+		_weight_mode = WeightMode::uniform;
 	}
+
+	// memory used for cached rows of weighted lattice is kept below limit_bytes
+	void set_distance_cache_limit(size_t limit_bytes) {
+		std::lock_guard<std::mutex> lock(_row_mutex);
+		_row_cache_limit = limit_bytes;
+		_row_list.clear();
+		_row_map.clear();
+	}
+	void clear_distance_cache() {
+		std::lock_guard<std::mutex> lock(_row_mutex);
+		_row_list.clear();
+		_row_map.clear();
+	}
+
+	// in normal weighted graph, left and right boundary is the same node
 	virtual WeightType get_weight(NodeIndex n1, NodeIndex n2) const {
-		assert(n1 < _num_node && n2 < _num_node);
-		return _weighted_graph[n1][n2];
+		return _distance_oracle(BoundaryMode::joined, n1, n2);
 	}
+	// weights[k] = get_weight(source, targets[k]) for k < count
+	//  on the weighted lattice, the row of source is looked up once for all the targets larger than source
+	virtual void get_weight_row(NodeIndex source, const NodeIndex* targets, size_t count, WeightType* weights) const {
+		assert(_weight_mode != WeightMode::none);
+		if (_weight_mode == WeightMode::uniform) {
+			for (size_t k = 0; k < count; ++k) weights[k] = _uniform_distance(BoundaryMode::joined, source, targets[k]);
+			return;
+		}
+		bool use_row = false;
+		for (size_t k = 0; k < count; ++k) {
+			if (targets[k] < source) weights[k] = _weighted_distance(BoundaryMode::joined, source, targets[k]);
+			else use_row = true;
+		}
+		if (!use_row) return;
+		_read_distance_row(BoundaryMode::joined, source, [&](const std::vector<WeightType>& row) {
+			for (size_t k = 0; k < count; ++k) {
+				if (targets[k] >= source) weights[k] = row[targets[k]];
+			}
+		});
+	}
+	// in no_boundary graph, two boundary nodes are isolated
 	virtual WeightType get_weight_without_boundary(NodeIndex n1, NodeIndex n2) const {
-		assert(n1 < _num_node && n2 < _num_node);
-		return _weighted_graph_no_boundary[n1][n2];
+		return _distance_oracle(BoundaryMode::isolated, n1, n2);
 	}
+	// in two_boundary graph, there are two boundary nodes, but they are not connected
 	virtual WeightType get_weight_separate_boundary(NodeIndex n1, NodeIndex n2) const {
-		assert(n1 < _num_node && n2 < _num_node);
-		return _weighted_graph_two_boundary[n1][n2];
+		return _distance_oracle(BoundaryMode::separate, n1, n2);
 	}
 
 
@@ -304,12 +497,12 @@ public:
 		if (n2 < n1) std::swap(n1, n2);
 		assert(n2 > n1);
 		assert(n1 != _boundary_main_id && n1 != _boundary_sub_id);
-		WeightType weight = _weighted_graph[n1][n2];
-		WeightType weight_nobnd = _weighted_graph_no_boundary[n1][n2];
-		WeightType n1_main = _weighted_graph_two_boundary[n1][_boundary_main_id];
-		WeightType n1_sub = _weighted_graph_two_boundary[n1][_boundary_sub_id];
-		WeightType n2_main = _weighted_graph_two_boundary[n2][_boundary_main_id];
-		WeightType n2_sub = _weighted_graph_two_boundary[n2][_boundary_sub_id];
+		WeightType weight = get_weight(n1, n2);
+		WeightType weight_nobnd = get_weight_without_boundary(n1, n2);
+		WeightType n1_main = get_weight_separate_boundary(n1, _boundary_main_id);
+		WeightType n1_sub = get_weight_separate_boundary(n1, _boundary_sub_id);
+		WeightType n2_main = get_weight_separate_boundary(n2, _boundary_main_id);
+		WeightType n2_sub = get_weight_separate_boundary(n2, _boundary_sub_id);
 		if (n2 == _boundary_main_id || n2 == _boundary_sub_id) {
 			// matched to boundary
 			if (n1_main < n1_sub) check_parity ^= 1;
@@ -383,12 +576,12 @@ public:
 	}
 
 	virtual unsigned int get_cost(NodeIndex n1, NodeIndex n2) const {
-		WeightType weight = _weighted_graph[n1][n2];
-		WeightType weight_nobnd = _weighted_graph_no_boundary[n1][n2];
-		WeightType n1_main = _weighted_graph_two_boundary[n1][_boundary_main_id];
-		WeightType n1_sub = _weighted_graph_two_boundary[n1][_boundary_sub_id];
-		WeightType n2_main = _weighted_graph_two_boundary[n2][_boundary_main_id];
-		WeightType n2_sub = _weighted_graph_two_boundary[n2][_boundary_sub_id];
+		WeightType weight = get_weight(n1, n2);
+		WeightType weight_nobnd = get_weight_without_boundary(n1, n2);
+		WeightType n1_main = get_weight_separate_boundary(n1, _boundary_main_id);
+		WeightType n1_sub = get_weight_separate_boundary(n1, _boundary_sub_id);
+		WeightType n2_main = get_weight_separate_boundary(n2, _boundary_main_id);
+		WeightType n2_sub = get_weight_separate_boundary(n2, _boundary_sub_id);
 
 		unsigned int cost = 0;
 		Position pos1 = this->index_to_position(n1);
@@ -414,12 +607,12 @@ public:
 	}
 
 	virtual void debug_print_matching(NodeIndex n1, NodeIndex n2) const {
-		WeightType weight = _weighted_graph[n1][n2];
-		WeightType weight_nobnd = _weighted_graph_no_boundary[n1][n2];
-		WeightType n1_main = _weighted_graph_two_boundary[n1][_boundary_main_id];
-		WeightType n1_sub = _weighted_graph_two_boundary[n1][_boundary_sub_id];
-		WeightType n2_main = _weighted_graph_two_boundary[n2][_boundary_main_id];
-		WeightType n2_sub = _weighted_graph_two_boundary[n2][_boundary_sub_id];
+		WeightType weight = get_weight(n1, n2);
+		WeightType weight_nobnd = get_weight_without_boundary(n1, n2);
+		WeightType n1_main = get_weight_separate_boundary(n1, _boundary_main_id);
+		WeightType n1_sub = get_weight_separate_boundary(n1, _boundary_sub_id);
+		WeightType n2_main = get_weight_separate_boundary(n2, _boundary_main_id);
+		WeightType n2_sub = get_weight_separate_boundary(n2, _boundary_sub_id);
 		printf("pair (%3d,%3d) : ", n1, n2);
 		printf("pathcomp (%lf, %lf) ", weight, weight_nobnd);
 		printf("ms1 (%lf, %lf) ", n1_main, n1_sub);
@@ -0,0 +1,117 @@
+// Copyright 2022 NTT CORPORATION
+
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/*
+Binary trajectory format of syndrome samples.
+
+- header: TrajectoryHeader (little endian, header_size bytes)
+- body: for each trial, for each lattice (X, Z), for each layer, syndrome bits of num_node_layer nodes packed in row_bytes bytes
+  - the i-th node of a layer is the (i%8)-th bit (LSB first) of the (i/8)-th byte, and padding bits are zero
+  - node i of X lattice is at (x, y) = (2*(i%width_x)+1, 2*(i/width_x)), and that of Z lattice is at (2*(i%width_z), 2*(i/width_z)+1)
+
+The body is a C-ordered array of shape (trial_count, num_lattice, num_layer, row_bytes),
+so it can be loaded with np.memmap and expanded with np.unpackbits(..., axis=-1, bitorder="little").
+*/
+struct TrajectoryHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t distance;
+	uint32_t num_layer;
+	uint32_t num_node_layer;
+	uint32_t row_bytes;
+	uint32_t num_lattice;
+	uint32_t width_x;
+	uint32_t width_z;
+	uint32_t trial_count;
+	// anomalous region is |x-anomaly_center|<anomaly_size, |y-anomaly_center|<anomaly_size, and layers in [anomaly_layer_begin, anomaly_layer_end)
+	int32_t anomaly_size;
+	int32_t anomaly_center;
+	uint32_t anomaly_layer_begin;
+	uint32_t anomaly_layer_end;
+	double error_prob;
+	double anomaly_ratio;
+};
+static_assert(sizeof(TrajectoryHeader) == 80, "TrajectoryHeader must not have padding");
+
+class TrajectoryWriter {
+private:
+	std::ofstream _ofs;
+	TrajectoryHeader _header;
+	std::vector<uint8_t> _buffer;
+	size_t _chunk_bytes;
+	uint32_t _trial_written;
+
+	void _pack(const std::vector<uint8_t>& node_list) {
+		assert(node_list.size() == (size_t)_header.num_layer * _header.num_node_layer);
+		size_t offset = _buffer.size();
+		_buffer.resize(offset + (size_t)_header.num_layer * _header.row_bytes, 0);
+		uint8_t* row = _buffer.data() + offset;
+		const uint8_t* node = node_list.data();
+		for (uint32_t layer = 0; layer < _header.num_layer; ++layer) {
+			for (uint32_t i = 0; i < _header.num_node_layer; ++i) {
+				row[i >> 3] |= (uint8_t)((node[i] & 1) << (i & 7));
+			}
+			row += _header.row_bytes;
+			node += _header.num_node_layer;
+		}
+	}
+
+	void _flush() {
+		_ofs.write((const char*)_buffer.data(), _buffer.size());
+		_buffer.clear();
+	}
+
+public:
+	static TrajectoryHeader make_header(uint32_t distance, uint32_t num_layer, uint32_t trial_count) {
+		TrajectoryHeader header;
+		std::memset(&header, 0, sizeof(header));
+		std::memcpy(header.magic, "Q3DETRJ", 8);
+		header.version = 1;
+		header.header_size = sizeof(TrajectoryHeader);
+		header.distance = distance;
+		header.num_layer = num_layer;
+		header.num_node_layer = distance * (distance - 1);
+		header.row_bytes = (header.num_node_layer + 7) / 8;
+		header.num_lattice = 2;
+		header.width_x = distance - 1;
+		header.width_z = distance;
+		header.trial_count = trial_count;
+		return header;
+	}
+
+	// trials are buffered and written every chunk_bytes
+	TrajectoryWriter(const std::string& filename, const TrajectoryHeader& header, size_t chunk_bytes = ((size_t)4) << 20)
+		: _ofs(filename, std::ios::out | std::ios::binary), _header(header), _chunk_bytes(chunk_bytes), _trial_written(0) {
+		if (!_ofs) throw std::runtime_error("cannot open " + filename);
+		_ofs.write((const char*)&_header, sizeof(_header));
+	}
+	virtual ~TrajectoryWriter() {
+		close();
+	}
+
+	void write_trial(const std::vector<uint8_t>& node_list_x, const std::vector<uint8_t>& node_list_z) {
+		_pack(node_list_x);
+		_pack(node_list_z);
+		_trial_written++;
+		if (_buffer.size() >= _chunk_bytes) _flush();
+	}
+
+	// flush the rest and record the number of trials actually written
+	void close() {
+		if (!_ofs.is_open()) return;
+		_flush();
+		_header.trial_count = _trial_written;
+		_ofs.seekp(0);
+		_ofs.write((const char*)&_header, sizeof(_header));
+		_ofs.close();
+	}
+};
@@ -0,0 +1,73 @@
+// Copyright 2022 NTT CORPORATION
+
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Parallel trial runner.
+
+Trials [0, trial_count) are split into chunks of chunk_size trials, and each worker thread takes the next chunk from a shared counter.
+A worker owns its own state (random stream, decoder, counters, ...), while read-only lattices are shared by all the workers.
+run_trial(worker, trial, output) performs a trial and appends its text output to output.
+Outputs of chunks are passed to consume(output) in trial order, so the result is the same as the serial loop
+if each trial only depends on its own random substream.
+*/
+template <class Worker, class RunTrial, class Consume>
+void run_trials_parallel(std::vector<Worker>& workers, uint32_t trial_count, RunTrial run_trial, Consume consume, uint32_t chunk_size = 64) {
+	uint32_t chunk_count = (trial_count + chunk_size - 1) / chunk_size;
+	std::vector<std::string> chunk_output(chunk_count);
+	std::vector<uint8_t> chunk_done(chunk_count, 0);
+	std::mutex mutex;
+	std::condition_variable cv;
+	uint32_t next_chunk = 0;
+	uint32_t next_consume = 0;
+	// bound the number of chunks waiting for the consumption of an older chunk
+	uint32_t max_pending = 4 * (uint32_t)workers.size();
+
+	auto work = [&](Worker& worker) {
+		std::string output;
+		while (true) {
+			uint32_t chunk;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				cv.wait(lock, [&] { return next_chunk >= chunk_count || next_chunk < next_consume + max_pending; });
+				if (next_chunk >= chunk_count) return;
+				chunk = next_chunk++;
+			}
+			output.clear();
+			uint32_t end = std::min(trial_count, (chunk + 1) * chunk_size);
+			for (uint32_t trial = chunk * chunk_size; trial < end; ++trial) {
+				run_trial(worker, trial, output);
+			}
+
+			std::unique_lock<std::mutex> lock(mutex);
+			chunk_output[chunk].swap(output);
+			chunk_done[chunk] = 1;
+			while (next_consume < chunk_count && chunk_done[next_consume]) {
+				consume(chunk_output[next_consume]);
+				std::string().swap(chunk_output[next_consume]);
+				next_consume++;
+			}
+			cv.notify_all();
+		}
+	};
+
+	if (workers.size() <= 1) {
+		if (workers.size() == 1) work(workers[0]);
+		return;
+	}
+	std::vector<std::thread> threads;
+	for (auto& worker : workers) {
+		threads.emplace_back(work, std::ref(worker));
+	}
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
@@ -1,5 +1,5 @@
 # Copyright 2022 NTT CORPORATION
 
 mkdir bin
-g++ -o ./bin/main.out ./src/main.cpp -O2
+g++ -o ./bin/main.out ./src/main.cpp -I../common -O2 -pthread
 
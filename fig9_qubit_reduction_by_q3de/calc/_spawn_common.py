@@ -37,6 +37,75 @@ def check(anomaly_size: float, anomaly_lifetime: int, distance: int, freq: float
         return lp_noq3de
 
 
+def check_points(points: list, q3de: bool, repeat: int = 1, lp_base: float = 0.1, p_pth: float = 0.1, max_cycle: int = 10**9, threads: int = 0, logname: str = "_log.txt") -> list:
+    """Check the averaged logical error rates of many points with a single process of C++ executable
+
+    Args:
+        points (list): list of (anomaly_size, anomaly_lifetime, distance, freq)
+        q3de (bool): use q3de or not
+        repeat (int, optional): number of runs for each point. Defaults to 1.
+        lp_base (float, optional): coefficient of logical error ansatz. Defaults to 0.1.
+        p_pth (float, optional): exponential base of logical error ansatz. Defaults to 0.1.
+        max_cycle (int, optional): simulation cycle number of each run. Defaults to 10**9.
+        threads (int, optional): number of threads, where 0 means all the cores. Defaults to 0.
+        logname (str, optional): Logname. Defaults to "_log.txt".
+
+    Returns:
+        list: logical error rate of each point averaged over the repeats
+    """
+    arg = [proc, "multi", logname, "-", repeat, lp_base, p_pth, max_cycle, "--threads", threads]
+    arg = list(map(str, arg))
+    text = "".join(" ".join(map(str, point)) + "\n" for point in points)
+    process = subprocess.run(arg, input=text.encode(), stdout=subprocess.PIPE, check=True)
+    lines = process.stdout.decode().splitlines()
+    index = -2 if q3de else -1
+    lps = [float(line.split()[index]) for line in lines]
+    return [float(np.mean(lps[i * repeat:(i + 1) * repeat])) for i in range(len(points))]
+
+
+def load_histograms(logname: str = "_log.txt") -> list:
+    """Load histograms of effective distances saved by the C++ executable
+
+    Args:
+        logname (str, optional): Logname. Defaults to "_log.txt".
+
+    Returns:
+        list: list of (anomaly_size, anomaly_lifetime, distance, freq, max_cycle, histogram), where histogram[d] is the number of cycles with effective distance d
+    """
+    result = []
+    with open(logname) as fin:
+        lines = fin.read().splitlines()
+    for header, body in zip(lines[0::2], lines[1::2]):
+        elements = header.split()
+        values = list(map(int, body.split()))
+        histogram = np.zeros(max(values[0::2]) + 1, dtype=np.int64)
+        histogram[values[0::2]] = values[1::2]
+        result.append((float(elements[0]), int(elements[1]), int(elements[2]), float(elements[3]), int(elements[4]), histogram))
+    return result
+
+
+def evaluate_histogram(histogram: np.ndarray, distance: int, max_cycle: int, lp_base, p_pth) -> tuple:
+    """Evaluate averaged logical error rates for many (lp_base, p_pth) at once without rerunning the simulation
+
+    Args:
+        histogram (np.ndarray): number of cycles for each effective distance
+        distance (int): code distance
+        max_cycle (int): simulation cycle number
+        lp_base (float or np.ndarray): coefficient of logical error ansatz
+        p_pth (float or np.ndarray): exponential base of logical error ansatz, broadcast with lp_base
+
+    Returns:
+        tuple: logical error rates with and without q3de, which have the broadcast shape of lp_base and p_pth
+    """
+    lp_base = np.asarray(lp_base, dtype=float)[..., None]
+    p_pth = np.asarray(p_pth, dtype=float)[..., None]
+    dist = np.arange(len(histogram))
+    dist_noq3de = np.maximum(0, distance - (distance - dist) * 2)
+    lp_q3de = np.sum(lp_base * p_pth ** ((dist + 1) / 2) * histogram, axis=-1) / max_cycle
+    lp_noq3de = np.sum(lp_base * p_pth ** ((dist_noq3de + 1) / 2) * histogram, axis=-1) / max_cycle
+    return lp_q3de, lp_noq3de
+
+
 def diagnose(anomaly_freq_org: float, chip_area_ratio: float, num_qubit_org: int, anomaly_size_org: float, anomaly_lifetime: int, q3de: bool, lp_require: float) -> tuple:
     """Check the required chip density according to a given chip area size by iteratively calculating the logical error rate
 
@@ -54,6 +123,8 @@ def diagnose(anomaly_freq_org: float, chip_area_ratio: float, num_qubit_org: int
     """
 
     # We assume d=11 is at least required for lp_require, this is correct in the region of our interest
+    # all the candidate distances up to the density limit are simulated at once on all the cores
+    candidates = []
     distance = 11
     while True:
         # calculate freq/size of anomaly for achieving the distance
@@ -61,11 +132,14 @@ def diagnose(anomaly_freq_org: float, chip_area_ratio: float, num_qubit_org: int
         anomaly_freq = anomaly_freq_org * chip_area_ratio
         qubit_density_ratio = (num_qubit / num_qubit_org) / chip_area_ratio
         anomaly_size = anomaly_size_org * np.sqrt(qubit_density_ratio)
-        print(q3de, chip_area_ratio, qubit_density_ratio, "/", anomaly_size, anomaly_lifetime, distance, anomaly_freq, end=" ", flush=True)
+        candidates.append((anomaly_size, anomaly_lifetime, distance, anomaly_freq, qubit_density_ratio))
+        if qubit_density_ratio > 1e2:
+            break
+        distance += 2
+    lp_list = check_points([item[:4] for item in candidates], q3de)
 
-        # calculate the logical error
-        lp = check(anomaly_size, anomaly_lifetime, distance, anomaly_freq, q3de)
-        print(lp)
+    for (anomaly_size, anomaly_lifetime, distance, anomaly_freq, qubit_density_ratio), lp in zip(candidates, lp_list):
+        print(q3de, chip_area_ratio, qubit_density_ratio, "/", anomaly_size, anomaly_lifetime, distance, anomaly_freq, lp)
 
         # if requirement satisfies, return information
         if lp < lp_require:
@@ -74,4 +148,3 @@ def diagnose(anomaly_freq_org: float, chip_area_ratio: float, num_qubit_org: int
         # if density exceeds x100, abort
         if qubit_density_ratio > 1e2:
             return (q3de, anomaly_size_org, chip_area_ratio, None, None, None, None)
-        distance += 2
@@ -5,8 +5,20 @@
 #include <random>
 #include <algorithm>
 #include <queue>
+#include <deque>
+#include <chrono>
 #include <string>
 #include <fstream>
+#include <cmath>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "random.hpp"
+#include "thread_option.hpp"
 
 using namespace std;
 
@@ -34,14 +46,6 @@ public:
     int lifetime;
 };
 
-class Node{
-public:
-    Node(int _x, int _y, int _cost): x(_x), y(_y), cost(_cost){};
-    int x;
-    int y;
-    int cost;
-};
-
 bool is_edge(int x, int y, int d){
     return (x>=1) && (x<2*d) && (y>=0) && (y<=2*d-2) &&((x+y)%2==1); 
 }
@@ -49,117 +53,301 @@ bool is_node(int x, int y, int d){
     return (x>=0) && (x<=2*d) && (y>=0) && (y<=2*d-2) && (x%2==0) && (y%2==0); 
 }
 
-vector<int> run(int seed, double freq, int max_cycle, double anomaly_size, int anomaly_lifetime, int distance){
+/*
+Effective code distance under anomalies, updated incrementally.
 
-    int plane_size = 2 * distance;
-    double margined_size = 4 * distance;
-    double shift = (margined_size - plane_size) / 2;
-    double margined_freq = freq * pow(margined_size / plane_size, 2);
-    mt19937 mt(seed);
-    poisson_distribution<> poisson(margined_freq);
-    uniform_real_distribution<> urd(0, margined_size);
+The lattice is stored in flat arrays of width 2*distance+1 and height 2*distance-1, where (x,y) is at index y*width+x.
+cover[i] is the number of anomalies covering edge i, and plane[i] is 1 if the edge is covered.
+search[i] is the shortest distance from the left boundary to node i, where an edge costs 0 if covered and 1 otherwise.
+Distances are found with Dial's algorithm, i.e., nodes are processed from a bucket per distance, so each node is expanded at most once.
+Adding or removing an anomaly only touches the edges it covers.
+When edges become covered, the distances are repaired by relaxation from the endpoints of those edges.
+When edges become uncovered, the distances are unchanged unless a shortest path passes through them,
+and they are recomputed from scratch only in that case.
+*/
+class EffectiveDistance {
+public:
+    int distance;
+    double shift;
+    double anomaly_size;
+    int width;
+    int height;
+    int INF;
+    vector<int> cover;
+    vector<uint8_t> plane;
+    vector<int> search;
+    // number of searches from scratch
+    long long recompute_count = 0;
+
+    EffectiveDistance(int _distance, double _shift, double _anomaly_size)
+        : distance(_distance), shift(_shift), anomaly_size(_anomaly_size),
+        width(_distance*2+1), height(_distance*2-1), INF(_distance*10),
+        cover(width*height, 0), plane(width*height, 0), search(width*height, 0), bucket(INF+1) {
+        recompute();
+    }
 
-    vector<Anomaly> anomaly_list;
-    bool update = true;
-    vector<vector<int>> plane(distance*2-1, vector<int>(distance*2+1, 0));
-    vector<vector<int>> search(distance*2-1, vector<int>(distance*2+1,0));
-    vector<int> effective_dist;
-    int last_effective_dist = distance;
+    void add(const Anomaly& ano){
+        for_each_covered_edge(ano, [&](int x, int y){
+            int i = y*width+x;
+            if(cover[i]++ > 0) return;
+            plane[i] = 1;
+            if(!need_recompute) covered_edges.push_back(i);
+        });
+    }
 
-    for(int cycle_count=0;cycle_count<max_cycle;++cycle_count){
-        // generate anomlay
-        int num_anomaly = poisson(mt);
-        for(int ki=0;ki<num_anomaly;++ki){
-            double x = urd(mt);
-            double y = urd(mt);
-            anomaly_list.push_back(Anomaly(x,y,anomaly_lifetime));
-            update = true;
+    void remove(const Anomaly& ano){
+        // distances must be valid to check whether shortest paths pass through the removed edges
+        if(!need_recompute) apply_pending();
+        for_each_covered_edge(ano, [&](int x, int y){
+            int i = y*width+x;
+            if(--cover[i] > 0) return;
+            plane[i] = 0;
+            if(!need_recompute && is_on_shortest_path(x, y)) need_recompute = true;
+        });
+    }
+
+    int get(){
+        apply_pending();
+        return effective_distance;
+    }
+
+    // recompute all the distances from scratch
+    void recompute(){
+        recompute_count += 1;
+        fill(search.begin(), search.end(), INF);
+        for(int y=0;y<height;y+=2){
+            search[y*width] = 0;
+            push(y*width, 0);
         }
+        relax();
+        update_effective_distance();
+        need_recompute = false;
+        covered_edges.clear();
+    }
 
-        if(update){
-            // mark plane
-            for(int y=0;y<plane.size();++y){
-                for(int x=0;x<plane[0].size();++x){
-                    if(!is_edge(x,y,distance)) continue;
-                    bool hit = false;
-                    double px = x + shift;
-                    double py = y + shift;
-                    for(const auto& ano : anomaly_list){
-                        //int dx = abs(ano.x-px);
-                        //int dy = abs(ano.y-py);
-                        if(ano.x <= px && px < ano.x+anomaly_size 
-                        && ano.y <= py && py < ano.y+anomaly_size){
-                            hit = true;
-                            break;
-                        }
-                    }
-                    if(hit){
-                        plane[y][x]=1;
-                    }else{                        
-                        plane[y][x]=0;
-                    }
-                }
-            }
+private:
+    bool need_recompute = false;
+    vector<int> covered_edges;
+    // bucket[c] is the list of nodes whose tentative distance is c, processed from lowest to highest
+    vector<vector<int>> bucket;
+    int lowest = 0;
+    int highest = -1;
+    int effective_distance = 0;
 
-            // search paths
-            int INF = distance*10;
-            for(int y=0;y<plane.size();++y){
-                for(int x=0;x<plane[0].size();++x){
-                    search[y][x] = INF;
-                }
+    // edges (x,y) with ano.x <= x+shift < ano.x+anomaly_size and ano.y <= y+shift < ano.y+anomaly_size
+    template <class Func>
+    void for_each_covered_edge(const Anomaly& ano, Func func){
+        int x_begin = max(0, (int)floor(ano.x - shift));
+        int x_end = min(width, (int)ceil(ano.x + anomaly_size - shift) + 1);
+        int y_begin = max(0, (int)floor(ano.y - shift));
+        int y_end = min(height, (int)ceil(ano.y + anomaly_size - shift) + 1);
+        for(int y=y_begin;y<y_end;++y){
+            double py = y + shift;
+            if(!(ano.y <= py && py < ano.y+anomaly_size)) continue;
+            for(int x=x_begin;x<x_end;++x){
+                if(!is_edge(x,y,distance)) continue;
+                double px = x + shift;
+                if(!(ano.x <= px && px < ano.x+anomaly_size)) continue;
+                func(x, y);
             }
-            queue<Node> queue;
-            for(int y=0;y<plane.size();y+=2){
-                search[y][0] = 0;
-                queue.push(Node(0,y,0));
-            }
-            while(!queue.empty()){
-                auto node = queue.front();
-                queue.pop();
-                if(search[node.y][node.x] < node.cost)continue;
-                int dx[] = {0,0,1};
-                int dy[] = {1,-1,0};
-                for(int i=0;i<3;++i){
-                    int px = node.x + dx[i]*2;
-                    int py = node.y + dy[i]*2;
-                    int pcost = node.cost;
-                    //cout << px << " " << py << " " << pcost << endl;
-                    if(!is_node(px,py,distance)) continue;
-                    if(plane[node.y+dy[i]][node.x+dx[i]]==0) pcost +=1;
-                    if(search[py][px] <= pcost) continue;
-                    search[py][px] = pcost;
-                    queue.push(Node(px,py,pcost));
+        }
+    }
+
+    // call func(source, target) with node indices for each move through edge (x,y)
+    //  horizontal edges are passed from left to right, and vertical edges in both directions
+    template <class Func>
+    void for_each_move(int x, int y, Func func){
+        int i = y*width+x;
+        if(x%2==1){
+            if(is_node(x-1,y,distance) && is_node(x+1,y,distance)) func(i-1, i+1);
+        }else if(is_node(x,y-1,distance) && is_node(x,y+1,distance)){
+            func(i-width, i+width);
+            func(i+width, i-width);
+        }
+    }
+
+    bool is_on_shortest_path(int x, int y){
+        bool tight = false;
+        for_each_move(x, y, [&](int source, int target){
+            if(search[source] < INF && search[source] == search[target]) tight = true;
+        });
+        return tight;
+    }
+
+    void apply_pending(){
+        if(need_recompute){
+            recompute();
+            return;
+        }
+        if(covered_edges.empty()) return;
+        for(int i : covered_edges){
+            for_each_move(i%width, i/width, [&](int source, int target){
+                if(search[source] < search[target]){
+                    search[target] = search[source];
+                    push(target, search[target]);
                 }
+            });
+        }
+        covered_edges.clear();
+        relax();
+        update_effective_distance();
+    }
+
+    void push(int node, int cost){
+        bucket[cost].push_back(node);
+        lowest = min(lowest, cost);
+        highest = max(highest, cost);
+    }
+
+    void relax(){
+        for(int cost=lowest;cost<=highest;++cost){
+            // moves through covered edges append nodes to the current bucket
+            for(size_t k=0;k<bucket[cost].size();++k){
+                int node = bucket[cost][k];
+                if(search[node] < cost) continue;
+                int x = node % width;
+                int y = node / width;
+                if(x+2 < width) relax_move(node+1, node+2, cost);
+                if(y+2 < height) relax_move(node+width, node+2*width, cost);
+                if(y-2 >= 0) relax_move(node-width, node-2*width, cost);
             }
-            last_effective_dist = INF;
-            for(int y=0;y<plane.size();++y){
-                last_effective_dist = min(last_effective_dist, search[y][2*distance]);
-            }
-            update = false;
+            bucket[cost].clear();
         }
-        effective_dist.push_back(last_effective_dist);
+        lowest = INF;
+        highest = -1;
+    }
+
+    void relax_move(int edge, int target, int cost){
+        int target_cost = cost + (plane[edge]==0);
+        if(search[target] <= target_cost) return;
+        search[target] = target_cost;
+        push(target, target_cost);
+    }
+
+    void update_effective_distance(){
+        effective_distance = INF;
+        for(int y=0;y<height;y+=2){
+            effective_distance = min(effective_distance, search[y*width+2*distance]);
+        }
+    }
+};
+
+// number of anomalies arriving in a cycle with at least one arrival, i.e., Poisson(lambda) conditioned on k >= 1
+//  for small lambda, the residual of the inverse-CDF search is taken from 1 - exp(-lambda) to avoid cancellation
+//  for large lambda, the search is O(lambda) and exp(-lambda) underflows, so Poisson(lambda) is redrawn until k >= 1
+int sample_positive_poisson(double lambda, Random& rng){
+    if(lambda > 30){
+        poisson_distribution<> poisson_dist(lambda);
+        int k;
+        do{
+            k = poisson_dist(rng);
+        }while(k == 0);
+        return k;
+    }
+    double residual = uniform_real_distribution<>(0, 1)(rng) * -expm1(-lambda);
+    double pk = lambda * exp(-lambda);
+    int k = 1;
+    while(residual >= pk && pk > 0){
+        residual -= pk;
+        k += 1;
+        pk *= lambda / k;
+    }
+    return k;
+}
+
+#ifdef _DEBUG
+// the sample mean of sample_positive_poisson must match lambda / (1 - exp(-lambda)) on both sides of the switch of the sampler
+void check_positive_poisson(){
+    const int sample_count = 100000;
+    for(double lambda : {0.01, 1.0, 29.0, 31.0, 745.0, 2000.0}){
+        Random rng(0, 0);
+        double sum = 0;
+        for(int i=0;i<sample_count;++i) sum += sample_positive_poisson(lambda, rng);
+        double positive = -expm1(-lambda);
+        double mean = lambda / positive;
+        double var = (lambda + lambda * lambda) / positive - mean * mean;
+        assert(fabs(sum / sample_count - mean) < 6 * sqrt(var / sample_count) + 1e-12);
+    }
+}
+#endif
+
+class Expiry{
+public:
+    Expiry(long long _cycle, const Anomaly& _anomaly): cycle(_cycle), anomaly(_anomaly){};
+    long long cycle;
+    Anomaly anomaly;
+    bool operator > (const Expiry& rhs) const { return cycle > rhs.cycle; }
+};
 
+/*
+Event-driven simulation of anomalies.
+The effective distance only changes when anomalies arrive or expire,
+so the simulation jumps between these events and counts the effective distance of all the cycles in between at once.
+The numbers of arrivals per cycle follow Poisson(margined_freq).
+The number of cycles without arrivals before the next arrival follows a geometric distribution with success probability 1 - exp(-margined_freq),
+and the number of arrivals in that cycle follows the Poisson distribution conditioned on at least one arrival.
+An anomaly arriving at cycle c is active during cycles [c, c + max(1, anomaly_lifetime)).
+Random numbers are taken from the stream-th substream of seed.
+*/
+vector<int> run(uint64_t seed, uint64_t stream, double freq, int max_cycle, double anomaly_size, int anomaly_lifetime, int distance){
+
+    int plane_size = 2 * distance;
+    double margined_size = 4 * distance;
+    double shift = (margined_size - plane_size) / 2;
+    double margined_freq = freq * pow(margined_size / plane_size, 2);
+    Random rng(seed, stream);
+    uniform_real_distribution<> urd(0, margined_size);
+    uniform_real_distribution<> unit(0, 1);
+
+    // cycles without arrivals before the next arrival
+    auto sample_gap = [&]() -> long long {
+        if(margined_freq <= 0) return max_cycle;
+        double gap = floor(-log(1 - unit(rng)) / margined_freq);
+        return (long long)min(gap, (double)max_cycle);
+    };
+
+    priority_queue<Expiry, vector<Expiry>, greater<Expiry>> expiry_queue;
+    EffectiveDistance engine(distance, shift, anomaly_size);
+    vector<int> counter(distance+1, 0);
+
+    long long cycle_count = 0;
+    long long next_arrival = sample_gap();
+    while(cycle_count < max_cycle){
         // remove anomaly
-        for(int ai=0;ai<anomaly_list.size();++ai){
-            anomaly_list[ai].lifetime -= 1;
-            if(anomaly_list[ai].lifetime<=0) update = true;
+        while(!expiry_queue.empty() && expiry_queue.top().cycle <= cycle_count){
+            engine.remove(expiry_queue.top().anomaly);
+            expiry_queue.pop();
         }
-        auto remove_itr = remove_if(anomaly_list.begin(), anomaly_list.end(), [](Anomaly a)->bool{ return a.lifetime<=0;});
-        anomaly_list.erase(remove_itr, anomaly_list.end());
+
+        // generate anomlay
+        if(next_arrival == cycle_count){
+            int num_anomaly = sample_positive_poisson(margined_freq, rng);
+            for(int ki=0;ki<num_anomaly;++ki){
+                double x = urd(rng);
+                double y = urd(rng);
+                Anomaly anomaly(x,y,anomaly_lifetime);
+                engine.add(anomaly);
+                expiry_queue.push(Expiry(cycle_count + max(1, anomaly_lifetime), anomaly));
+            }
+            next_arrival = cycle_count + 1 + sample_gap();
+        }
+
+        // the effective distance is constant until the next event
+        long long next_event = min(next_arrival, (long long)max_cycle);
+        if(!expiry_queue.empty()) next_event = min(next_event, expiry_queue.top().cycle);
+        int last_effective_dist = engine.get();
+        counter[last_effective_dist] += (int)(next_event - cycle_count);
 
         // visualize anomaly
 #ifdef _DEBUG
         bool debug = false;
         if(debug){
-            cout << "cycle " << cycle_count << endl;
-            /*
-            for(const auto& ano : anomaly_list) cout << ano.x << " " << ano.y << " " << ano.lifetime << endl;
-            */
-            for(int y=0;y<plane.size();++y){
-                for(int x=0;x<plane[0].size();++x){
-                    if(is_node(x,y,distance)) cout << search[y][x] << " ";
+            cout << "cycle " << cycle_count << " - " << next_event << endl;
+            for(int y=0;y<engine.height;++y){
+                for(int x=0;x<engine.width;++x){
+                    if(is_node(x,y,distance)) cout << engine.search[y*engine.width+x] << " ";
                     else if(is_edge(x,y,distance)) {
-                        if(plane[y][x]) cout << "* ";
+                        if(engine.plane[y*engine.width+x]) cout << "* ";
                         else cout << ". ";
                     }
                     else cout << "  ";
@@ -170,12 +358,9 @@ vector<int> run(int seed, double freq, int max_cycle, double anomaly_size, int a
             cout << last_effective_dist << endl;
         }
 #endif
+        cycle_count = next_event;
     }
 
-    vector<int> counter(distance+1, 0);
-    for(auto val : effective_dist){
-        counter[val]+=1;
-    }
     for(int i=0;i<counter.size();++i){
         //cout << i << " " << counter[i] << endl;
     }
@@ -191,7 +376,7 @@ double lp_noq3de(double base, double p_pth, int d, int od){
     return base * pow(p_pth, (d*1.+1)/2);
 }
 
-pair<double,double> stat(vector<int> result, int distance, double lp_base, double p_pth) {
+pair<double,double> stat(const vector<int>& result, int distance, double lp_base, double p_pth) {
     double sum = 0;
     double sum_noq3de = 0;
     for (int i = distance; i >= 0; i--) {
@@ -201,15 +386,241 @@ pair<double,double> stat(vector<int> result, int distance, double lp_base, doubl
     return make_pair(sum, sum_noq3de);
 }
 
+// the same as stat() for each (lp_base, p_pth) of params in a single pass over the histogram
+//  p_pth^((d+1)/2) is taken from a table of powers of sqrt(p_pth) instead of calling pow() per bin
+vector<pair<double,double>> stat_batch(const vector<int>& result, int distance, const vector<pair<double,double>>& params) {
+    int num_param = (int)params.size();
+    vector<double> power((distance+2) * num_param);
+    for (int j = 0; j < num_param; ++j) {
+        double root = sqrt(params[j].second);
+        power[j] = 1;
+        for (int k = 1; k <= distance+1; ++k) power[k*num_param + j] = power[(k-1)*num_param + j] * root;
+    }
+    vector<pair<double,double>> sums(num_param, make_pair(0., 0.));
+    for (int i = distance; i >= 0; i--) {
+        if (result[i] == 0) continue;
+        // distance without Q3DE, see lp_noq3de()
+        int d_noq3de = max(0, distance - (distance-i)*2);
+        for (int j = 0; j < num_param; ++j) {
+            sums[j].first += params[j].first * power[(i+1)*num_param + j] * result[i];
+            sums[j].second += params[j].first * power[(d_noq3de+1)*num_param + j] * result[i];
+        }
+    }
+    return sums;
+}
+
+vector<double> parse_list(const string& text) {
+    vector<double> values;
+    size_t begin = 0;
+    while (begin <= text.size()) {
+        size_t end = text.find(',', begin);
+        if (end == string::npos) end = text.size();
+        values.push_back(atof(text.substr(begin, end - begin).c_str()));
+        begin = end + 1;
+    }
+    return values;
+}
+
+// micro-benchmark of EffectiveDistance for distances 9 to 51
+//  an update is an arrival or an expiry of an anomaly of size anomaly_size with max_live anomalies alive, followed by get()
+void bench(uint64_t seed, double anomaly_size, int max_live){
+    using Clock = chrono::steady_clock;
+    cout << "distance full_search_us update_us recompute_ratio" << endl;
+    for(int d=9;d<=51;d+=2){
+        Random rng(seed, d);
+        uniform_real_distribution<> urd(0, 4*d);
+        EffectiveDistance engine(d, d, anomaly_size);
+
+        int full_repeat = 1000;
+        auto start = Clock::now();
+        for(int r=0;r<full_repeat;++r) engine.recompute();
+        double full_us = chrono::duration<double, micro>(Clock::now() - start).count() / full_repeat;
+
+        int update_repeat = 100000;
+        deque<Anomaly> live;
+        long long update_count = 0;
+        engine.recompute_count = 0;
+        start = Clock::now();
+        for(int r=0;r<update_repeat;++r){
+            live.push_back(Anomaly(urd(rng), urd(rng), 0));
+            engine.add(live.back());
+            engine.get();
+            update_count += 1;
+            if((int)live.size() > max_live){
+                engine.remove(live.front());
+                live.pop_front();
+                engine.get();
+                update_count += 1;
+            }
+        }
+        double update_us = chrono::duration<double, micro>(Clock::now() - start).count() / update_count;
+        cout << d << " " << full_us << " " << update_us << " " << 1. * engine.recompute_count / update_count << endl;
+    }
+}
+
+class Point{
+public:
+    double anomaly_size;
+    int anomaly_lifetime;
+    int distance;
+    double freq;
+};
+
+// print the logical error rates of a run to out, and append them with the histogram to ofs
+//  if lp_base_list or p_pth_list has several values, the rates of all the combinations are also printed to out
+void report(ostream& out, ostream& ofs, const Point& point, int max_cycle, const vector<int>& result, const vector<double>& lp_base_list, const vector<double>& p_pth_list) {
+    auto lps = stat(result, point.distance, lp_base_list[0], p_pth_list[0]);
+    double sum_q3de = lps.first;
+    double sum_noq3de = lps.second;
+
+    out << point.anomaly_size
+        << " " << point.anomaly_lifetime
+        << " " << point.distance
+        << " " << point.freq
+        << " " << max_cycle
+        << " " << sum_q3de / max_cycle
+        << " " << sum_noq3de / max_cycle
+        << endl;
+
+    ofs << point.anomaly_size
+        << " " << point.anomaly_lifetime
+        << " " << point.distance
+        << " " << point.freq
+        << " " << max_cycle
+        << " " << sum_q3de / max_cycle
+        << " " << sum_noq3de / max_cycle
+        << endl;
+    for (int i = 0;i<result.size();++i) {
+        ofs << i << " " << result[i] << " ";
+    }
+    ofs << endl;
+
+    // batch mode: lp_base and p_pth are comma-separated lists, and all the combinations are printed
+    //  "lp_base p_pth logical_error_rate_q3de logical_error_rate_noq3de"
+    if (lp_base_list.size() > 1 || p_pth_list.size() > 1) {
+        vector<pair<double,double>> params;
+        for (double base : lp_base_list) {
+            for (double pth : p_pth_list) params.push_back(make_pair(base, pth));
+        }
+        auto lps_list = stat_batch(result, point.distance, params);
+        for (size_t j = 0; j < params.size(); ++j) {
+            out << params[j].first
+                << " " << params[j].second
+                << " " << lps_list[j].first / max_cycle
+                << " " << lps_list[j].second / max_cycle
+                << endl;
+        }
+    }
+}
+
+/*
+Runs repeat times for each point on threads.
+The r-th repeat of the p-th point is the run index p * repeat + r, and it uses the substream of seed with that index,
+so the results only depend on the seed regardless of the number of threads.
+Reports are written in the order of run indices as soon as all the preceding runs have finished.
+*/
+void run_points(const string& filename, const vector<Point>& points, int repeat, int max_cycle, const vector<double>& lp_base_list, const vector<double>& p_pth_list, uint64_t seed, int threads) {
+    int run_count = (int)points.size() * repeat;
+    vector<string> out_text(run_count);
+    vector<string> ofs_text(run_count);
+    vector<char> done(run_count, 0);
+    atomic<int> next_run(0);
+    int next_write = 0;
+    mutex write_mutex;
+    ofstream ofs(filename, ios::app);
+
+    auto work = [&]() {
+        while (true) {
+            int index = next_run++;
+            if (index >= run_count) return;
+            const Point& point = points[index / repeat];
+            auto result = run(seed, index, point.freq, max_cycle, point.anomaly_size, point.anomaly_lifetime, point.distance);
+            ostringstream out, log;
+            report(out, log, point, max_cycle, result, lp_base_list, p_pth_list);
+
+            lock_guard<mutex> lock(write_mutex);
+            out_text[index] = out.str();
+            ofs_text[index] = log.str();
+            done[index] = 1;
+            while (next_write < run_count && done[next_write]) {
+                cout << out_text[next_write] << flush;
+                ofs << ofs_text[next_write] << flush;
+                string().swap(out_text[next_write]);
+                string().swap(ofs_text[next_write]);
+                next_write++;
+            }
+        }
+    };
+
+    vector<thread> workers;
+    for (int t = 1; t < min(threads, run_count); ++t) workers.emplace_back(work);
+    work();
+    for (auto& worker : workers) worker.join();
+    ofs.close();
+}
+
+// read points "anomaly_size anomaly_lifetime distance freq" line by line
+vector<Point> read_points(istream& in) {
+    vector<Point> points;
+    Point point;
+    while (in >> point.anomaly_size >> point.anomaly_lifetime >> point.distance >> point.freq) {
+        points.push_back(point);
+    }
+    return points;
+}
+
 int main(int argc, char** argv){
+#ifdef _DEBUG
+    check_positive_poisson();
+#endif
+    SeedOption seed_option;
+    argc = seed_option.parse(argc, argv);
+    ThreadOption thread_option;
+    argc = thread_option.parse(argc, argv);
+    int threads = (int)thread_option.get();
+
+    if (argc > 1 && string(argv[1]) == "bench") {
+        // bench [anomaly_size] [max_live]
+        double bench_anomaly_size = (argc > 2) ? atof(argv[2]) : 2.0;
+        int bench_max_live = (argc > 3) ? atoi(argv[3]) : 8;
+        bench(seed_option.fixed ? seed_option.value : 0, bench_anomaly_size, bench_max_live);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "multi") {
+        // multi filename points_file repeat lp_base p_pth max_cycle
+        //  points_file has a point "anomaly_size anomaly_lifetime distance freq" per line, and "-" reads points from stdin
+        if (argc != 8) {
+            cerr << "invalid argument" << endl;
+            exit(1);
+        }
+        vector<Point> points;
+        if (string(argv[3]) == "-") {
+            points = read_points(cin);
+        }
+        else {
+            ifstream ifs(argv[3]);
+            if (!ifs) {
+                cerr << "cannot open " << argv[3] << endl;
+                exit(1);
+            }
+            points = read_points(ifs);
+        }
+        int repeat = atoi(argv[4]);
+        vector<double> lp_base_list = parse_list(argv[5]);
+        vector<double> p_pth_list = parse_list(argv[6]);
+        int max_cycle = atoi(argv[7]);
+        uint64_t seed = seed_option.get();
+        run_points(argv[2], points, repeat, max_cycle, lp_base_list, p_pth_list, seed, threads);
+        return 0;
+    }
     string filename = "result.txt";
     double anomaly_size = 0.25;
     int anomaly_lifetime = 3000;
     int distance = 9;
     double freq = 10;
     int max_cycle = 100000;
-    double lp_base = 0.1;
-    double p_pth = 0.1;
+    vector<double> lp_base_list = {0.1};
+    vector<double> p_pth_list = {0.1};
 
     if (argc > 1){
         if (argc != 9) {
@@ -221,41 +632,17 @@ int main(int argc, char** argv){
         anomaly_lifetime = atoi(argv[3]);
         distance = atoi(argv[4]);
         freq = atof(argv[5]);
-        lp_base = atof(argv[6]);
-        p_pth = atof(argv[7]);
+        lp_base_list = parse_list(argv[6]);
+        p_pth_list = parse_list(argv[7]);
         max_cycle = atoi(argv[8]);
     }
 
-    random_device rd;
-    int seed = rd();
-
-    auto result = run(seed, freq, max_cycle, anomaly_size, anomaly_lifetime, distance);
-    auto lps = stat(result, distance, lp_base, p_pth);
-    double sum_q3de = lps.first;
-    double sum_noq3de = lps.second;
-
-    cout << anomaly_size
-        << " " << anomaly_lifetime
-        << " " << distance
-        << " " << freq
-        << " " << max_cycle
-        << " " << sum_q3de / max_cycle
-        << " " << sum_noq3de / max_cycle
-        << endl;
+    uint64_t seed = seed_option.get();
 
+    auto result = run(seed, 0, freq, max_cycle, anomaly_size, anomaly_lifetime, distance);
+    Point point = {anomaly_size, anomaly_lifetime, distance, freq};
     ofstream ofs(filename, ios::app);
-    ofs << anomaly_size
-        << " " << anomaly_lifetime
-        << " " << distance
-        << " " << freq
-        << " " << max_cycle
-        << " " << sum_q3de / max_cycle
-        << " " << sum_noq3de / max_cycle
-        << endl;
-    for (int i = 0;i<result.size();++i) {
-        ofs << i << " " << result[i] << " ";
-    }
-    ofs << endl;
+    report(cout, ofs, point, max_cycle, result, lp_base_list, p_pth_list);
     ofs.close();
 
     return 0;